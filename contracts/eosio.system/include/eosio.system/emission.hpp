@@ -0,0 +1,113 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace eosiosystem { namespace emission {
+
+   /**
+    *  Fixed-point token emission.
+    *
+    *  The target emission is 20% per year while at most 33% of the supply is actively voting, 10% per year
+    *  from 66% on and linear in between. Continuous (compounded every block of an hour) rates of this curve
+    *  are computed at compile time for every 0.1% of activated share and linearly interpolated, so claims
+    *  only use integer arithmetic. Interpolation error is below 1e-8 in absolute rate, about 1e-7 of emission.
+    *
+    *  The header has no eosiolib dependencies and is shared with the native unit tests.
+    */
+
+   static constexpr int64_t  rate_precision   = 1'000'000'000'000ll; ///< rates are fractions of rate_precision
+   static constexpr int64_t  share_precision  = 1'000'000'000;       ///< activated share is in billionths
+   static constexpr int64_t  min_share        = 330'000'000;         ///< 33%, max emission below
+   static constexpr int64_t  max_share        = 660'000'000;         ///< 66%, min emission above
+   static constexpr int64_t  share_step       = 1'000'000;           ///< table resolution, 0.1%
+   static constexpr uint32_t blocks_per_hour  = 2 * 3600;
+   static constexpr int64_t  days_per_year    = 52 * 7;
+   static constexpr int64_t  useconds_per_day = 24 * 3600 * int64_t(1000000);
+
+   static constexpr size_t   table_size       = (max_share - min_share) / share_step + 1;
+
+   /// ln(1 + x) = 2 * atanh( x / (2 + x) ), converges quickly for 0 <= x <= 1
+   constexpr double log1p_series( double x ) {
+      const double z  = x / (2 + x);
+      const double z2 = z * z;
+      double term = z;
+      double sum  = 0;
+      for( int k = 0; k < 24; ++k ) {
+         sum  += term / (2 * k + 1);
+         term *= z2;
+      }
+      return 2 * sum;
+   }
+
+   /// e^y - 1 for small y
+   constexpr double expm1_series( double y ) {
+      double term = y;
+      double sum  = 0;
+      for( int k = 2; k < 16; ++k ) {
+         sum  += term;
+         term *= y / k;
+      }
+      return sum;
+   }
+
+   /// same as ( pow(1 + emission_rate, 1./blocks_per_hour) - 1 ) * blocks_per_hour
+   constexpr double continuous_rate( double emission_rate ) {
+      return expm1_series( log1p_series( emission_rate ) / blocks_per_hour ) * blocks_per_hour;
+   }
+
+   constexpr std::array<int64_t, table_size> make_continuous_rates() {
+      std::array<int64_t, table_size> rates{};
+      for( size_t i = 0; i < table_size; ++i ) {
+         const double emission_rate = 0.2 - 0.1 * double(i) / double(table_size - 1);
+         rates[i] = int64_t( continuous_rate( emission_rate ) * rate_precision + 0.5 );
+      }
+      return rates;
+   }
+
+   /// continuous rates for activated share of min_share, min_share + share_step, ..., max_share
+   static constexpr std::array<int64_t, table_size> continuous_rates = make_continuous_rates();
+
+   static_assert( continuous_rates[0] > continuous_rates[table_size - 1], "emission must decrease with activated share" );
+
+   /**
+    *  @return continuous emission rate in fractions of rate_precision
+    */
+   inline int64_t get_continuous_rate( int64_t active_stake, int64_t supply ) {
+      const int64_t share = int64_t( (__int128(active_stake) * share_precision) / supply );
+      if( share <= min_share ) {
+         return continuous_rates.front();
+      } else if( share >= max_share ) {
+         return continuous_rates.back();
+      }
+      const auto i = (share - min_share) / share_step;
+      const auto r = (share - min_share) % share_step;
+      return continuous_rates[i] - (continuous_rates[i] - continuous_rates[i + 1]) * r / share_step;
+   }
+
+   /**
+    *  @return floor( rate * supply * usecs / (rate_precision * useconds_per_year) ), computed exactly
+    */
+   inline int64_t get_emission( int64_t rate, int64_t supply, int64_t usecs ) {
+      using int128 = __int128;
+      constexpr int128 k = int128(rate_precision) * days_per_year;
+      constexpr int128 d = k * useconds_per_day; // rate_precision * useconds_per_year
+
+      // with rate * supply = q * d + r and usecs = days * useconds_per_day + u:
+      // rate * supply * usecs / d = q * usecs + r * days / k + r * u / d, no product exceeds 2^127
+      const int128 yearly = int128(rate) * supply;
+      const int128 q      = yearly / d;
+      const int128 r      = yearly % d;
+      const int128 days   = usecs / useconds_per_day;
+      const int128 u      = usecs % useconds_per_day;
+      const int128 x      = r * days;
+
+      return int64_t( q * usecs + x / k + ((x % k) * useconds_per_day + r * u) / d );
+   }
+
+} } /// namespace eosiosystem::emission
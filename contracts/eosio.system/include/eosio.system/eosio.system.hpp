@@ -6,12 +6,17 @@
 
 #include <eosio.system/native.hpp>
 #include <eosiolib/asset.hpp>
+#include <eosiolib/binary_extension.hpp>
 #include <eosiolib/time.hpp>
 #include <eosiolib/privileged.hpp>
 #include <eosiolib/singleton.hpp>
 #include <eosio.system/exchange_state.hpp>
+#include <eosio.system/instrumentation.hpp>
+#include <eosio.system/voting_math.hpp>
 #include <eosio.system/contracts.version.hpp>
 
+#include <boost/container/flat_map.hpp>
+
 #include <string>
 #include <deque>
 #include <type_traits>
@@ -69,11 +74,11 @@ namespace eosiosystem {
       uint64_t primary_key()const { return bidder.value; }
    };
 
-   typedef eosio::multi_index< "namebids"_n, name_bid,
+   typedef tables::multi_index< "namebids"_n, name_bid,
                                indexed_by<"highbid"_n, const_mem_fun<name_bid, uint64_t, &name_bid::by_high_bid>  >
                              > name_bid_table;
 
-   typedef eosio::multi_index< "bidrefunds"_n, bid_refund > bid_refund_table;
+   typedef tables::multi_index< "bidrefunds"_n, bid_refund > bid_refund_table;
 
    struct [[eosio::table("global"), eosio::contract("eosio.system")]] eosio_global_state : eosio::blockchain_parameters {
       uint64_t free_ram()const { return max_ram_size - total_ram_bytes_reserved; }
@@ -107,6 +112,27 @@ namespace eosiosystem {
                                 (last_target_schedule_size_update)(schedule_update_interval)(schedule_size_step) )
    };
 
+   /**
+    * Order of the producers in the proposed schedule
+    */
+   enum class schedule_order_type : uint8_t {
+      by_name     = 0,
+      /// `location` is a position on a ring of zones (e.g. a longitude or UTC offset bucket), ascending
+      /// location order then visits every zone once per round and minimizes the total handoff distance
+      by_location = 1
+   };
+
+   /**
+    * Part of the "prototalvote" index the producer sweep of rescalevote walks. Rescaling moves the keys towards zero,
+    * so rescaling the rows closest to zero first keeps the order of the index: first the rows without a negative key
+    * upwards, then the active producers with votes downwards.
+    */
+   enum class producer_sweep_phase_type : uint8_t {
+      none       = 0,
+      ascending  = 1,
+      descending = 2
+   };
+
    /**
     * Defines new global state parameters added after version 1.0
     */
@@ -131,6 +157,47 @@ namespace eosiosystem {
       EOSLIB_SERIALIZE( eosio_global_state3, (last_vpay_state_update)(total_vpay_share_change_rate) )
    };
 
+   /**
+    * Global state parameters added after global3, kept apart so that the stored rows of the older
+    * singletons keep decoding
+    */
+   struct [[eosio::table("global4"), eosio::contract("eosio.system")]] eosio_global_state4 {
+      eosio_global_state4() { }
+      uint8_t           schedule_order = 0; ///< one of schedule_order_type
+      uint16_t          autopay_batch_size = 0; ///< producers settled automatically per schedule update, 0 disables
+      name              autopay_cursor; ///< last producer settled automatically
+      uint16_t          vote_epoch = 0; ///< vote weights and votepay shares are stored in units of 2^vote_epoch
+      name              vote_sweep_cursor; ///< last voter rescaled by the running sweep, see rescalevote
+      bool              vote_sweep_pending = false; ///< some voters may still hold weights of an older epoch
+      uint32_t          vote_expiry_time = 0; ///< seconds after which votes that were not renewed are withdrawn, 0 disables
+      name              proxy_index_cursor; ///< last voter indexed by indexproxies
+      bool              proxy_index_complete = false; ///< every voter using a proxy has a proxyfollow row
+      double            vote_propagation_epsilon = 1; ///< smaller weight changes are held back as pending votes
+      uint16_t          vote_flush_batch_size = 20; ///< pending votes propagated per schedule update
+      uint8_t           schedule_size_strategy = 0; ///< one of voting_math::schedule_size_strategy_type
+      uint16_t          schedule_size_band = 0; ///< distance to the target amount the hysteresis strategy tolerates
+      uint8_t           schedule_size_gain = 50; ///< percent of the distance the proportional strategy moves by
+      uint32_t          maintenance_budget = 100; ///< rows the maintenance tasks may process per block, 0 disables them
+      name              maintenance_cursor; ///< last maintenance task run
+      uint32_t          next_maintenance_slot = 0; ///< earliest slot a maintenance task is due at
+      bool              emission_streaming = false; ///< the emission task fills the pay buckets, claims only settle
+      name              vote_activity_cursor; ///< last voter visited by indexvoteact
+      bool              vote_activity_complete = false; ///< every account currently voting has a voteact row
+      uint8_t           producer_sweep_phase = 0; ///< one of producer_sweep_phase_type
+      name              producer_sweep_cursor; ///< last producer rescaled in the current phase, empty before the first
+      double            producer_sweep_key = 0; ///< "prototalvote" key of producer_sweep_cursor
+      double            producer_sweep_scale = 1; ///< converts producers the sweep did not reach yet to vote_epoch
+
+      EOSLIB_SERIALIZE( eosio_global_state4, (schedule_order)
+                        (autopay_batch_size)(autopay_cursor)(vote_epoch)(vote_sweep_cursor)(vote_sweep_pending)
+                        (vote_expiry_time)(proxy_index_cursor)(proxy_index_complete)
+                        (vote_propagation_epsilon)(vote_flush_batch_size)
+                        (schedule_size_strategy)(schedule_size_band)(schedule_size_gain)
+                        (maintenance_budget)(maintenance_cursor)(next_maintenance_slot)(emission_streaming)
+                        (vote_activity_cursor)(vote_activity_complete)
+                        (producer_sweep_phase)(producer_sweep_cursor)(producer_sweep_key)(producer_sweep_scale) )
+   };
+
    struct [[eosio::table, eosio::contract("eosio.system")]] producer_info {
       name                  owner;
       double                total_votes = 0;
@@ -184,24 +251,199 @@ namespace eosiosystem {
 
 
       uint32_t            flags1 = 0;
-      uint32_t            reserved2 = 0;
+      uint32_t            vote_epoch = 0; /// epoch of last_vote_weight and proxied_vote_weight, formerly reserved2
       eosio::asset        reserved3;
 
       uint64_t primary_key()const { return owner.value; }
       bool is_active() const { return producers.size() || proxy; }
 
+      /// converts the vote weights of the voter to `epoch`, exactly since the scale is a power of two
+      void rescale( uint32_t epoch ) {
+         if( vote_epoch < epoch ) {
+            const double scale = voting_math::epoch_scale( vote_epoch, epoch );
+            last_vote_weight    *= scale;
+            proxied_vote_weight *= scale;
+            vote_epoch = epoch;
+         }
+      }
+
       enum class flags1_fields : uint32_t {
          ram_managed = 1,
          net_managed = 2,
-         cpu_managed = 4
+         cpu_managed = 4,
+         vote_pending = 8  ///< listed in votepending, last_vote_weight lags behind the current weight
       };
 
       bool has_voted = false;
 
       // explicit serialization macro is not necessary, used here only to improve compilation time
-      EOSLIB_SERIALIZE( voter_info, (owner)(proxy)(producers)(staked)(last_vote_weight)(proxied_vote_weight)(is_proxy)(flags1)(reserved2)(reserved3)(has_voted) )
+      EOSLIB_SERIALIZE( voter_info, (owner)(proxy)(producers)(staked)(last_vote_weight)(proxied_vote_weight)(is_proxy)(flags1)(vote_epoch)(reserved3)(has_voted) )
+   };
+
+
+   struct elected_candidate {
+      name                  owner;
+      double                total_votes = 0;
+      eosio::public_key     producer_key;
+      uint16_t              location = 0;
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( elected_candidate, (owner)(total_votes)(producer_key)(location) )
+   };
+
+   /**
+    * Ordered top-N of the election candidates, maintained incrementally on every producer vote change
+    * so that the schedule update does not have to walk the producers table.
+    *
+    * Every active producer with positive votes which is not in `candidates` has at most `max_excluded_votes`,
+    * hence the leading candidates with more votes than that are exactly the top of the "prototalvote" index.
+    *
+    * The order of `candidates` is exact, their total_votes are only rewritten with a change of the order or membership
+    * and may lag behind the producers table otherwise.
+    */
+   struct [[eosio::table("electcache"), eosio::contract("eosio.system")]] election_cache {
+      std::vector<elected_candidate> candidates; /// sorted by current total_votes descending, then by owner
+      double                         max_excluded_votes = 0;
+      uint16_t                       capacity = 0;
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( election_cache, (candidates)(max_excluded_votes)(capacity) )
+   };
+
+   /**
+    * Outcome of the last election, published for off-chain readers and only rewritten when it changes
+    */
+   struct [[eosio::table("electpreview"), eosio::contract("eosio.system")]] election_preview {
+      std::vector<name> producers; /// elected producers by rank, before the schedule order is applied
+      uint16_t          target_schedule_size = 0;
+      double            cutoff_votes = 0; /// total_votes of the lowest ranked elected producer
+      uint16_t          vote_epoch = 0; /// epoch of cutoff_votes
+      block_timestamp   last_change;
+
+      bool same_election( const election_preview& o )const {
+         return producers == o.producers && target_schedule_size == o.target_schedule_size
+                && cutoff_votes == o.cutoff_votes && vote_epoch == o.vote_epoch;
+      }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( election_preview, (producers)(target_schedule_size)(cutoff_votes)(vote_epoch)(last_change) )
+   };
+
+   /**
+    * Producers whose pay is settled on schedule updates instead of calling claimrewards, with the pay settled
+    * and not sent yet. onblock never transfers to producers, it schedules a deferred autopayout instead.
+    */
+   struct [[eosio::table, eosio::contract("eosio.system")]] autopay_info {
+      name     owner;
+      int64_t  per_block_pay = 0;
+      int64_t  per_vote_pay = 0;
+
+      uint64_t primary_key()const { return owner.value; }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( autopay_info, (owner)(per_block_pay)(per_vote_pay) )
    };
 
+   /**
+    * Time of the last vote of every voter currently voting, kept apart from voter_info so that the existing
+    * voters table does not need a new secondary index
+    */
+   struct [[eosio::table, eosio::contract("eosio.system")]] vote_activity {
+      name            owner;
+      time_point_sec  last_vote_time;
+
+      uint64_t primary_key()const  { return owner.value; }
+      uint64_t by_last_vote()const { return last_vote_time.sec_since_epoch(); }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( vote_activity, (owner)(last_vote_time) )
+   };
+
+   /**
+    * Periodic work run by onblock, at most `batch_size` rows per run and only while the block budget lasts
+    */
+   struct [[eosio::table, eosio::contract("eosio.system")]] maintenance_task {
+      name     task;
+      uint32_t interval = 0; ///< slots between runs
+      uint16_t batch_size = 0;
+      uint32_t next_slot = 0; ///< slot the task is due at
+
+      uint64_t primary_key()const { return task.value; }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( maintenance_task, (task)(interval)(batch_size)(next_slot) )
+   };
+
+   /**
+    * Voter whose weight changed by less than the propagation epsilon since its weight was last passed on
+    */
+   struct [[eosio::table, eosio::contract("eosio.system")]] pending_vote {
+      name owner;
+
+      uint64_t primary_key()const { return owner.value; }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( pending_vote, (owner) )
+   };
+
+   /**
+    * Vote-seconds to take off the share a producer accrued at its current votes since its producers2 row was last
+    * written, lets vote changes inside the 3 day window accrue votepay without writing producers2. Rows are billed to
+    * the contract, so votes cast by others never grow a row billed to the producer, and are removed on settlement.
+    */
+   struct [[eosio::table, eosio::contract("eosio.system")]] producer_votepay_offset {
+      name     owner;
+      double   offset = 0;
+
+      uint64_t primary_key()const { return owner.value; }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( producer_votepay_offset, (owner)(offset) )
+   };
+
+   /**
+    * Account delegating its vote to the proxy the table is scoped by, with the stake counted in the proxy aggregate
+    */
+   struct [[eosio::table, eosio::contract("eosio.system")]] proxy_follower {
+      name     owner;
+      int64_t  staked = 0;
+
+      uint64_t primary_key()const { return owner.value; }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( proxy_follower, (owner)(staked) )
+   };
+
+   /**
+    * Aggregates of the followers of a proxy and the state of a running rebuildproxy
+    */
+   struct [[eosio::table, eosio::contract("eosio.system")]] proxy_stats {
+      name     owner;
+      uint32_t followers = 0;
+      int64_t  staked = 0;
+      bool     rebuilding = false;
+      name     rebuild_cursor; ///< last follower summed up
+      double   rebuild_weight = 0; ///< vote weight of the followers up to rebuild_cursor, in rebuild_epoch
+      uint16_t rebuild_epoch = 0;
+
+      uint64_t primary_key()const { return owner.value; }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( proxy_stats, (owner)(followers)(staked)(rebuilding)(rebuild_cursor)(rebuild_weight)(rebuild_epoch) )
+   };
+
+   struct producer_payout {
+      name     owner;
+      int64_t  per_block_pay = 0;
+      int64_t  per_vote_pay = 0;
+   };
+
+   struct pay_snapshot {
+      int64_t  perblock_bucket = 0;
+      int64_t  pervote_bucket = 0;
+      uint32_t total_unpaid_blocks = 0;
+      double   total_votepay_share = 0;
+   };
 
    struct [[eosio::table("version"), eosio::contract("eosio.system")]] version_info {
       std::string version = CONTRACTS_VERSION;
@@ -209,21 +451,43 @@ namespace eosiosystem {
    };
    
 
-   typedef eosio::multi_index< "voters"_n, voter_info >  voters_table;
+   typedef tables::multi_index< "voters"_n, voter_info >  voters_table;
 
 
-   typedef eosio::multi_index< "producers"_n, producer_info,
+   typedef tables::multi_index< "producers"_n, producer_info,
                                indexed_by<"prototalvote"_n, const_mem_fun<producer_info, double, &producer_info::by_votes>  >
                              > producers_table;
-   typedef eosio::multi_index< "producers2"_n, producer_info2 > producers_table2;
+   typedef tables::multi_index< "producers2"_n, producer_info2 > producers_table2;
+
+   typedef tables::multi_index< "autopay"_n, autopay_info > autopay_table;
+
+   typedef tables::multi_index< "proxyfollow"_n, proxy_follower > proxy_follower_table;
+   typedef tables::multi_index< "proxystats"_n, proxy_stats >     proxy_stats_table;
+
+   typedef tables::multi_index< "voteact"_n, vote_activity,
+                               indexed_by<"bylastvote"_n, const_mem_fun<vote_activity, uint64_t, &vote_activity::by_last_vote> >
+                             > vote_activity_table;
+
+   typedef tables::multi_index< "votepending"_n, pending_vote > pending_vote_table;
 
-   typedef eosio::singleton< "global"_n, eosio_global_state >   global_state_singleton;
-   typedef eosio::singleton< "global2"_n, eosio_global_state2 > global_state2_singleton;
-   typedef eosio::singleton< "global3"_n, eosio_global_state3 > global_state3_singleton;
-   typedef eosio::singleton< "version"_n, version_info >        contracts_version_singleton;
+   typedef tables::multi_index< "votepayoff"_n, producer_votepay_offset > votepay_offset_table;
+
+   typedef tables::multi_index< "maintasks"_n, maintenance_task > maintenance_task_table;
+
+   typedef tables::singleton< "global"_n, eosio_global_state >   global_state_singleton;
+   typedef tables::singleton< "global2"_n, eosio_global_state2 > global_state2_singleton;
+   typedef tables::singleton< "global3"_n, eosio_global_state3 > global_state3_singleton;
+   typedef tables::singleton< "global4"_n, eosio_global_state4 > global_state4_singleton;
+   typedef tables::singleton< "version"_n, version_info >        contracts_version_singleton;
+   typedef tables::singleton< "electcache"_n, election_cache >   election_cache_singleton;
+   typedef tables::singleton< "electpreview"_n, election_preview > election_preview_singleton;
+
+   /// vote weight change per producer, sorted by name, and whether the producer is in the new vote set
+   typedef boost::container::flat_map< name, std::pair<double, bool> > producer_delta_map;
 
    static constexpr uint32_t     seconds_per_day = 24 * 3600;
    static const double           min_producer_activated_share = 0;
+   static constexpr uint16_t     election_cache_margin = 10; /// candidates kept in the election cache above the target schedule size
 
    class [[eosio::contract("eosio.system")]] system_contract : public native {
 
@@ -234,11 +498,16 @@ namespace eosiosystem {
          global_state_singleton  _global;
          global_state2_singleton _global2;
          global_state3_singleton _global3;
+         global_state4_singleton _global4;
          eosio_global_state      _gstate;
          eosio_global_state2     _gstate2;
          eosio_global_state3     _gstate3;
+         eosio_global_state4     _gstate4;
          rammarket               _rammarket;
          contracts_version_singleton _contracts_version;
+         election_cache_singleton    _electcache;
+         std::optional<election_cache> _ecache; ///< loaded on first use, most actions never touch it
+         bool                          _ecache_dirty = false;
 
       public:
          static constexpr eosio::name active_permission{"active"_n};
@@ -363,10 +632,128 @@ namespace eosiosystem {
          [[eosio::action]]
          void setparams( const eosio::blockchain_parameters& params );
 
+         /**
+          *  Selects how elected producers are ordered in the proposed schedule, see schedule_order_type.
+          */
+         [[eosio::action]]
+         void setprodorder( uint8_t order );
+
+         /**
+          *  Selects how the target schedule size moves towards the amount for the activated stake, see
+          *  voting_math::schedule_size_strategy_type.
+          */
+         [[eosio::action]]
+         void setschedsize( uint8_t strategy, uint16_t step, uint16_t band, uint8_t gain );
+
+         /**
+          *  Rebuilds the election cache from the producers table. The cache is maintained incrementally,
+          *  so this is only needed as an explicit consistency check.
+          */
+         [[eosio::action]]
+         void rebuildelect();
+
+         /**
+          *  Moves vote weights to the current vote epoch and rescales at most `max_rows` voters stored in an older
+          *  epoch. Anyone may call it, it never changes the outcome of an election.
+          */
+         [[eosio::action]]
+         void rescalevote( uint32_t max_rows );
+
+         /**
+          *  Sets after how many seconds without a new vote the votes of an account are withdrawn, 0 disables expiry.
+          */
+         [[eosio::action]]
+         void setvoteexp( uint32_t expiry_time );
+
+         /**
+          *  Withdraws the votes of at most `max_rows` accounts, oldest first, which did not vote within the vote expiry
+          *  time. Anyone may call it.
+          */
+         [[eosio::action]]
+         void expirevotes( uint32_t max_rows );
+
+         /**
+          *  Sets the vote weight change below which propagation to proxies and producers is held back and how many
+          *  held back votes are propagated per schedule update.
+          */
+         [[eosio::action]]
+         void setvoteprop( double epsilon, uint16_t flush_batch_size );
+
+         /**
+          *  Adds the vote activity rows of accounts that voted before the voteact table existed, at most `max_rows`
+          *  voters per call. Anyone may call it.
+          */
+         [[eosio::action]]
+         void indexvoteact( uint32_t max_rows );
+
+         // functions defined in proxies.cpp
+
+         /**
+          *  Adds the followers of proxies that delegated before the follower index existed, at most `max_rows`
+          *  voters per call. Anyone may call it.
+          */
+         [[eosio::action]]
+         void indexproxies( uint32_t max_rows );
+
+         /**
+          *  Recomputes the proxied vote weight of `proxy` from its followers, at most `max_rows` followers per call,
+          *  and propagates the result once the last follower is summed up. Anyone may call it.
+          */
+         [[eosio::action]]
+         void rebuildproxy( const name proxy, uint32_t max_rows );
+
          // functions defined in producer_pay.cpp
          [[eosio::action]]
          void claimrewards( const name owner );
 
+         /**
+          *  Claims rewards of several producers at once, requires the authority of every one of them.
+          *  Buckets are filled once and the pay of each producer is transferred in a single transfer.
+          */
+         [[eosio::action]]
+         void bulkclaim( const std::vector<name>& owners );
+
+         /**
+          *  Opts the producer in or out of automatic payouts, see setpaybatch. Opting out sends the accrued pay.
+          */
+         [[eosio::action]]
+         void setautopay( const name producer, bool enabled );
+
+         /**
+          *  Sends the pay the schedule updates settled for an opted-in producer. The schedule updates send it as a
+          *  deferred transaction, anyone may call it again if that failed.
+          */
+         [[eosio::action]]
+         void autopayout( const name producer );
+
+         /**
+          *  Sets how many opted-in producers are paid on every schedule update, 0 disables automatic payouts.
+          */
+         [[eosio::action]]
+         void setpaybatch( uint16_t batch_size );
+
+         /**
+          *  Issues the emission since the last bucket fill and funds the pay buckets, sent by the emission
+          *  maintenance task as a deferred transaction.
+          */
+         [[eosio::action]]
+         void fillbuckets();
+
+         // functions defined in maintenance.cpp
+
+         /**
+          *  Schedules the maintenance task `task` every `interval` slots, processing at most `batch_size` rows per run.
+          *  An interval of 0 removes the task.
+          */
+         [[eosio::action]]
+         void settask( const name task, uint32_t interval, uint16_t batch_size );
+
+         /**
+          *  Sets the number of rows all maintenance tasks together may process per block, 0 disables them.
+          */
+         [[eosio::action]]
+         void setmaintbudg( uint32_t budget );
+
          [[eosio::action]]
          void setpriv( name account, uint8_t is_priv );
 
@@ -398,7 +785,22 @@ namespace eosiosystem {
          using setramrate_action = eosio::action_wrapper<"setramrate"_n, &system_contract::setramrate>;
          using voteproducer_action = eosio::action_wrapper<"voteproducer"_n, &system_contract::voteproducer>;
          using regproxy_action = eosio::action_wrapper<"regproxy"_n, &system_contract::regproxy>;
+         using rebuildelect_action = eosio::action_wrapper<"rebuildelect"_n, &system_contract::rebuildelect>;
+         using rescalevote_action = eosio::action_wrapper<"rescalevote"_n, &system_contract::rescalevote>;
+         using setvoteexp_action = eosio::action_wrapper<"setvoteexp"_n, &system_contract::setvoteexp>;
+         using setvoteprop_action = eosio::action_wrapper<"setvoteprop"_n, &system_contract::setvoteprop>;
+         using expirevotes_action = eosio::action_wrapper<"expirevotes"_n, &system_contract::expirevotes>;
+         using indexvoteact_action = eosio::action_wrapper<"indexvoteact"_n, &system_contract::indexvoteact>;
+         using indexproxies_action = eosio::action_wrapper<"indexproxies"_n, &system_contract::indexproxies>;
+         using rebuildproxy_action = eosio::action_wrapper<"rebuildproxy"_n, &system_contract::rebuildproxy>;
          using claimrewards_action = eosio::action_wrapper<"claimrewards"_n, &system_contract::claimrewards>;
+         using bulkclaim_action = eosio::action_wrapper<"bulkclaim"_n, &system_contract::bulkclaim>;
+         using setautopay_action = eosio::action_wrapper<"setautopay"_n, &system_contract::setautopay>;
+         using autopayout_action = eosio::action_wrapper<"autopayout"_n, &system_contract::autopayout>;
+         using setpaybatch_action = eosio::action_wrapper<"setpaybatch"_n, &system_contract::setpaybatch>;
+         using fillbuckets_action = eosio::action_wrapper<"fillbuckets"_n, &system_contract::fillbuckets>;
+         using settask_action = eosio::action_wrapper<"settask"_n, &system_contract::settask>;
+         using setmaintbudg_action = eosio::action_wrapper<"setmaintbudg"_n, &system_contract::setmaintbudg>;
          using rmvproducer_action = eosio::action_wrapper<"rmvproducer"_n, &system_contract::rmvproducer>;
          using updtrevision_action = eosio::action_wrapper<"updtrevision"_n, &system_contract::updtrevision>;
          using bidname_action = eosio::action_wrapper<"bidname"_n, &system_contract::bidname>;
@@ -406,6 +808,8 @@ namespace eosiosystem {
          using setpriv_action = eosio::action_wrapper<"setpriv"_n, &system_contract::setpriv>;
          using setalimits_action = eosio::action_wrapper<"setalimits"_n, &system_contract::setalimits>;
          using setparams_action = eosio::action_wrapper<"setparams"_n, &system_contract::setparams>;
+         using setprodorder_action = eosio::action_wrapper<"setprodorder"_n, &system_contract::setprodorder>;
+         using setschedsize_action = eosio::action_wrapper<"setschedsize"_n, &system_contract::setschedsize>;
 
       private:
 
@@ -434,15 +838,61 @@ namespace eosiosystem {
          void update_voting_power( const name& voter, const asset& total_update );
 
          // defined in voting.hpp
+         void update_target_schedule_size( block_timestamp timestamp );
          void update_elected_producers( block_timestamp timestamp );
+         election_cache* get_election_cache();
+         void update_election_cache( const producer_info& prod );
+         void rebuild_election_cache();
+         void publish_election_preview( election_preview&& preview, block_timestamp block_time );
          void update_votes( const name voter, const name proxy, const std::vector<name>& producers, bool voting );
-         void propagate_weight_change( const voter_info& voter );
-         double update_producer_votepay_share( const producers_table2::const_iterator& prod_itr,
-                                               time_point ct,
-                                               double shares_rate, bool reset_to_zero = false );
+         void propagate_weight_change( const voter_info& voter, bool force = false );
+         void set_vote_pending( const voter_info& voter, bool pending );
+         void flush_pending_votes( uint32_t max_rows );
+         void apply_producer_deltas( const producer_delta_map& deltas, bool voting );
+         void rescale_voter( const voter_info& voter );
+         void advance_vote_epoch( uint16_t epoch );
+         bool producer_rescaled( double key, const name owner )const;
+         double producer_scale( const producer_info& prod )const;
+         double producer_votes( const producer_info& prod )const;
+         void rescale_producer( const producer_info& prod, double scale );
+         void place_producer( const producer_info& prod, double scale );
+         uint32_t rescale_producers( uint32_t max_rows );
+         bool rescale_votes( uint32_t max_rows );
+         void update_vote_activity( const voter_info& voter );
+         bool index_vote_activity( uint32_t max_rows );
+         void withdraw_votes( const voter_info& voter, producer_delta_map& deltas );
+         bool expire_stale_votes( uint32_t max_rows );
+         double votepay_offset( const name producer )const;
+         void set_votepay_offset( const name producer, double offset );
+         double producer_votepay_share( const producer_info& prod, const producer_info2& prod2, time_point ct )const;
+         double settle_producer_votepay_share( const producer_info& prod, const producers_table2::const_iterator& prod2,
+                                               time_point ct, bool accrue );
          double update_total_votepay_share( time_point ct,
                                             double additional_shares_delta = 0.0, double shares_rate_delta = 0.0 );
 
+         // defined in proxies.cpp
+         bool index_proxies( uint32_t max_rows );
+         void update_proxy_follower( const voter_info& voter, const name old_proxy );
+         void remove_proxy_follower( const name proxy, const name follower );
+         void update_proxy_stats( const name proxy, int32_t followers_delta, int64_t staked_delta );
+         void track_proxy_rebuild( const name proxy, const name follower, double weight_delta );
+
+         // defined in producer_pay.cpp
+         void fill_pay_buckets( time_point ct );
+         void fill_pay_buckets_on_claim( time_point ct );
+         void send_bucket_fill();
+         pay_snapshot take_pay_snapshot( time_point ct );
+         producer_payout settle_producer_pay( const producer_info& prod, time_point ct, pay_snapshot& snapshot );
+         void send_producer_pay( const std::vector<producer_payout>& payouts, bool owner_auth );
+         void autopay_producers( uint16_t batch_size );
+         void send_autopayout( const name producer );
+
+         // defined in maintenance.cpp
+         void run_maintenance( block_timestamp timestamp );
+         void run_maintenance_task( const name task, uint32_t max_rows );
+         void update_next_maintenance_slot( const maintenance_task_table& tasks );
+         void update_emission_streaming( const maintenance_task_table& tasks );
+
          template <auto system_contract::*...Ptrs>
          class registration {
             public:
@@ -0,0 +1,56 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosio.system/instrumentation.hpp>
+
+#include <cmath>
+#include <cstdint>
+
+namespace eosiosystem { namespace exchange_math {
+
+   /**
+    *  Bancor conversion kernels of exchange_state, on raw amounts.
+    *
+    *  The header has no eosiolib dependencies outside of instrumented builds and is shared with the native benchmarks.
+    */
+
+   /**
+    *  @return amount of the relay token issued when `in` is deposited to a connector with `balance` and `weight`
+    */
+   inline int64_t convert_to_exchange( int64_t supply, int64_t balance, double weight, int64_t in ) {
+      const double R(supply);
+      const double C(balance + in);
+      const double F(weight);
+      const double T(in);
+      const double ONE(1.0);
+
+      SYSTEM_COUNT( pow );
+      const double E = -R * (ONE - std::pow( ONE + T / C, F) );
+      return int64_t(E);
+   }
+
+   /**
+    *  @return amount taken out of a connector with `balance` and `weight` when `in` of the relay token is returned
+    */
+   inline int64_t convert_from_exchange( int64_t supply, int64_t balance, double weight, int64_t in ) {
+      const double R(supply - in);
+      const double C(balance);
+      const double F(1.0/weight);
+      const double E(in);
+      const double ONE(1.0);
+
+      // potentially more accurate:
+      // The functions std::expm1 and std::log1p are useful for financial calculations, for example,
+      // when calculating small daily interest rates: (1+x)n
+      // -1 can be expressed as std::expm1(n * std::log1p(x)).
+      // double T = C * std::expm1( F * std::log1p(E/R) );
+
+      SYSTEM_COUNT( pow );
+      const double T = C * (std::pow( ONE + E/R, F) - ONE);
+      return int64_t(T);
+   }
+
+} } /// namespace eosiosystem::exchange_math
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <eosiolib/asset.hpp>
+#include <eosio.system/instrumentation.hpp>
 
 namespace eosiosystem {
    using eosio::asset;
@@ -35,6 +36,6 @@ namespace eosiosystem {
       EOSLIB_SERIALIZE( exchange_state, (supply)(base)(quote) )
    };
 
-   typedef eosio::multi_index< "rammarket"_n, exchange_state > rammarket;
+   typedef tables::multi_index< "rammarket"_n, exchange_state > rammarket;
 
 } /// namespace eosiosystem
@@ -0,0 +1,227 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+/**
+ *  Hot path counters of the system contract, compiled in with EOSIO_SYSTEM_INSTRUMENTATION only
+ *  (cmake -DCONTRACTS_INSTRUMENTATION=ON). The option is off for every build type, Debug builds included.
+ *
+ *  The tables of the contract are declared through `tables::multi_index` and `tables::singleton`, which are
+ *  the eosiolib templates in release builds and counting wrappers around them in instrumented builds.
+ *  Inline actions are counted by INLINE_ACTION_SENDER, deferred transactions and pow calls at their call
+ *  sites. The system_contract destructor prints one summary line per action, e.g.
+ *
+ *     [instr] voters f1 m1 | producers f3 m3 i1 | global g1 m1 | inline 0 deferred 0 pow 2
+ *
+ *  with f(ind), g(et), e(mplace), m(odify), r(emove) and i(ndex) counts per table; singleton sets count as modify.
+ *
+ *  The header is also included by the kernels shared with the native benchmarks, where it compiles to nothing.
+ */
+#ifdef EOSIO_SYSTEM_INSTRUMENTATION
+
+#include <eosiolib/action.hpp>
+#include <eosiolib/multi_index.hpp>
+#include <eosiolib/print.hpp>
+#include <eosiolib/singleton.hpp>
+
+#define SYSTEM_COUNT( counter ) ( ++::eosiosystem::instrumentation::counters().counter )
+
+/// every INLINE_ACTION_SENDER( contract, action )( ... ) counts the inline action it sends
+#undef INLINE_ACTION_SENDER2
+#define INLINE_ACTION_SENDER2( CONTRACT_CLASS, NAME ) \
+   ( SYSTEM_COUNT( inline_actions ), INLINE_ACTION_SENDER3( CONTRACT_CLASS, NAME, ::eosio::name(#NAME) ) )
+
+namespace eosiosystem { namespace instrumentation {
+
+   struct table_counters {
+      uint64_t table = 0;
+      uint16_t find = 0;
+      uint16_t get = 0;
+      uint16_t emplace = 0;
+      uint16_t modify = 0;
+      uint16_t remove = 0;
+      uint16_t index = 0;
+   };
+
+   struct action_counters {
+      static constexpr size_t max_tables = 24;
+
+      table_counters tables[max_tables];
+      size_t         table_count = 0;
+      uint32_t       inline_actions = 0;
+      uint32_t       deferred = 0;
+      uint32_t       pow = 0;
+
+      table_counters& table( uint64_t name ) {
+         for( size_t i = 0; i < table_count; ++i ) {
+            if( tables[i].table == name )
+               return tables[i];
+         }
+         if( table_count == max_tables ) // shared by the tables beyond the limit
+            return tables[max_tables - 1];
+         tables[table_count].table = name;
+         return tables[table_count++];
+      }
+
+      void print()const {
+         eosio::print( "[instr]" );
+         for( size_t i = 0; i < table_count; ++i ) {
+            const auto& t = tables[i];
+            eosio::print( " ", eosio::name(t.table) );
+            print_count( "f", t.find );
+            print_count( "g", t.get );
+            print_count( "e", t.emplace );
+            print_count( "m", t.modify );
+            print_count( "r", t.remove );
+            print_count( "i", t.index );
+            eosio::print( " |" );
+         }
+         eosio::print( " inline ", inline_actions, " deferred ", deferred, " pow ", pow, "\n" );
+      }
+
+   private:
+      static void print_count( const char* label, uint16_t count ) {
+         if( count )
+            eosio::print( " ", label, count );
+      }
+   };
+
+   /// counters of the running action, every action runs in a fresh instance of the contract
+   inline action_counters& counters() {
+      static action_counters c;
+      return c;
+   }
+
+   template<eosio::name::raw TableName, typename T, typename... Indices>
+   class multi_index : public eosio::multi_index<TableName, T, Indices...> {
+   public:
+      using base = eosio::multi_index<TableName, T, Indices...>;
+      using typename base::const_iterator;
+      using base::base;
+
+      const_iterator find( uint64_t primary )const {
+         ++counts().find;
+         return base::find( primary );
+      }
+
+      const_iterator require_find( uint64_t primary, const char* error_msg = "unable to find key" )const {
+         ++counts().find;
+         return base::require_find( primary, error_msg );
+      }
+
+      const T& get( uint64_t primary, const char* error_msg = "unable to find key" )const {
+         ++counts().get;
+         return base::get( primary, error_msg );
+      }
+
+      template<typename Lambda>
+      const_iterator emplace( eosio::name payer, Lambda&& constructor ) {
+         ++counts().emplace;
+         return base::emplace( payer, std::forward<Lambda>( constructor ) );
+      }
+
+      template<typename Lambda>
+      void modify( const_iterator itr, eosio::name payer, Lambda&& updater ) {
+         ++counts().modify;
+         base::modify( itr, payer, std::forward<Lambda>( updater ) );
+      }
+
+      template<typename Lambda>
+      void modify( const T& obj, eosio::name payer, Lambda&& updater ) {
+         ++counts().modify;
+         base::modify( obj, payer, std::forward<Lambda>( updater ) );
+      }
+
+      const_iterator erase( const_iterator itr ) {
+         ++counts().remove;
+         return base::erase( itr );
+      }
+
+      void erase( const T& obj ) {
+         ++counts().remove;
+         base::erase( obj );
+      }
+
+      /// counts the index objects handed out, lookups through them are not counted
+      template<eosio::name::raw IndexName>
+      auto get_index() {
+         ++counts().index;
+         return base::template get_index<IndexName>();
+      }
+
+      template<eosio::name::raw IndexName>
+      auto get_index()const {
+         ++counts().index;
+         return base::template get_index<IndexName>();
+      }
+
+   private:
+      static table_counters& counts() {
+         return counters().table( static_cast<uint64_t>( TableName ) );
+      }
+   };
+
+   template<eosio::name::raw SingletonName, typename T>
+   class singleton : public eosio::singleton<SingletonName, T> {
+   public:
+      using base = eosio::singleton<SingletonName, T>;
+      using base::base;
+
+      bool exists() {
+         ++counts().find;
+         return base::exists();
+      }
+
+      T get() {
+         ++counts().get;
+         return base::get();
+      }
+
+      T get_or_default( const T& def = T() ) {
+         ++counts().get;
+         return base::get_or_default( def );
+      }
+
+      T get_or_create( eosio::name bill_to_account, const T& def = T() ) {
+         ++counts().get;
+         return base::get_or_create( bill_to_account, def );
+      }
+
+      void set( const T& value, eosio::name bill_to_account ) {
+         ++counts().modify;
+         base::set( value, bill_to_account );
+      }
+
+      void remove() {
+         ++counts().remove;
+         base::remove();
+      }
+
+   private:
+      static table_counters& counts() {
+         return counters().table( static_cast<uint64_t>( SingletonName ) );
+      }
+   };
+
+} /// namespace instrumentation
+
+   namespace tables = instrumentation;
+
+} /// namespace eosiosystem
+
+#else
+
+#define SYSTEM_COUNT( counter ) ( (void)0 )
+
+#ifdef __wasm__
+#include <eosiolib/multi_index.hpp>
+#include <eosiolib/singleton.hpp>
+
+namespace eosiosystem {
+   namespace tables = eosio;
+}
+#endif
+
+#endif
@@ -0,0 +1,94 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosio.system/instrumentation.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+namespace eosiosystem { namespace voting_math {
+
+   /**
+    *  Vote weight and schedule size kernels of voting.cpp.
+    *
+    *  The header has no eosiolib dependencies outside of instrumented builds and is shared with the native benchmarks.
+    */
+
+   static constexpr int64_t seconds_per_week = 7 * 24 * 3600;
+
+   /**
+    *  @return producer schedule size the schedule is moved towards at `activated_share` percent of the supply voting
+    */
+   inline int32_t get_target_amount( int32_t activated_share ) {
+      if (activated_share <= 33) {
+        return 21;
+      } else if (activated_share > 33 && activated_share < 60) {
+        return 21 + (activated_share - 33) * 3;
+      }
+      return 102;
+   }
+
+   /// how the schedule size moves towards the target amount
+   enum class schedule_size_strategy_type : uint8_t {
+      fixed_step   = 0, ///< by `step` towards the target
+      hysteresis   = 1, ///< by `step`, not past the target, once the target is more than `band` away
+      proportional = 2  ///< by `gain_percent` of the distance to the target, at least 1
+   };
+
+   /**
+    *  @param strategy one of schedule_size_strategy_type, unknown strategies move by a fixed step
+    *  @param gain_percent at most 100, so that the proportional strategy does not overshoot
+    *  @return schedule size following `size` on the way to `target`
+    */
+   inline int32_t next_schedule_size( int32_t size, int32_t target, uint8_t strategy, int32_t step, int32_t band, int32_t gain_percent ) {
+      const int32_t distance = std::abs( target - size );
+      if( distance == 0 ) {
+         return size;
+      }
+      const int32_t direction = target > size ? 1 : -1;
+      switch( static_cast<schedule_size_strategy_type>( strategy ) ) {
+         case schedule_size_strategy_type::hysteresis:
+            return distance <= band ? size : size + direction * std::min( step, distance );
+         case schedule_size_strategy_type::proportional:
+            return size + direction * std::max( 1, distance * gain_percent / 100 );
+         default:
+            return size + direction * step;
+      }
+   }
+
+   /**
+    *  Vote weights are stored relative to a vote epoch: in epoch `e` a weight `w` stands for `w * 2^e`. Since the
+    *  weight of a stake doubles every 52 weeks, moving to the epoch of the current year keeps stored weights
+    *  within a factor of two of the stake.
+    *
+    *  @param seconds_since_epoch seconds since the block timestamp epoch
+    *  @return vote epoch of the 52 week period containing `seconds_since_epoch`
+    */
+   inline uint16_t vote_epoch( int64_t seconds_since_epoch ) {
+      return uint16_t( seconds_since_epoch / seconds_per_week / 52 );
+   }
+
+   /**
+    *  @return factor converting a weight of epoch `from` to epoch `to`, a power of two so that the conversion is exact
+    */
+   inline double epoch_scale( uint32_t from, uint32_t to ) {
+      return std::ldexp( 1.0, int32_t(from) - int32_t(to) );
+   }
+
+   /**
+    *  @param seconds_since_epoch seconds since the block timestamp epoch
+    *  @param epoch vote epoch of the result
+    *  @return vote weight of `staked`, doubling every 52 weeks
+    */
+   inline double stake2vote( int64_t staked, int64_t seconds_since_epoch, uint32_t epoch = 0 ) {
+      double weight = int64_t( seconds_since_epoch / seconds_per_week ) / double( 52 ) - epoch;
+      SYSTEM_COUNT( pow );
+      return double(staked) * std::pow( 2, weight );
+   }
+
+} } /// namespace eosiosystem::voting_math
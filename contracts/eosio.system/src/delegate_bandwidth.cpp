@@ -79,9 +79,9 @@ namespace eosiosystem {
     *  These tables are designed to be constructed in the scope of the relevant user, this
     *  facilitates simpler API for per-user queries
     */
-   typedef eosio::multi_index< "userres"_n, user_resources >      user_resources_table;
-   typedef eosio::multi_index< "delband"_n, delegated_bandwidth > del_bandwidth_table;
-   typedef eosio::multi_index< "refunds"_n, refund_request >      refunds_table;
+   typedef tables::multi_index< "userres"_n, user_resources >      user_resources_table;
+   typedef tables::multi_index< "delband"_n, delegated_bandwidth > del_bandwidth_table;
+   typedef tables::multi_index< "refunds"_n, refund_request >      refunds_table;
 
 
 
@@ -421,6 +421,7 @@ namespace eosiosystem {
             );
             out.delay_sec = refund_delay_sec;
             cancel_deferred( from.value ); // TODO: Remove this line when replacing deferred trxs is fixed
+            SYSTEM_COUNT( deferred );
             out.send( from.value, from, true );
          } else {
             cancel_deferred( from.value );
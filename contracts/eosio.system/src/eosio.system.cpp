@@ -5,6 +5,8 @@
 #include "producer_pay.cpp"
 #include "delegate_bandwidth.cpp"
 #include "voting.cpp"
+#include "proxies.cpp"
+#include "maintenance.cpp"
 #include "exchange_state.cpp"
 
 namespace eosiosystem {
@@ -17,12 +19,15 @@ namespace eosiosystem {
     _global(_self, _self.value),
     _global2(_self, _self.value),
     _global3(_self, _self.value),
+    _global4(_self, _self.value),
     _rammarket(_self, _self.value),
-    _contracts_version(_self, _self.value)
+    _contracts_version(_self, _self.value),
+    _electcache(_self, _self.value)
    {
       _gstate  = _global.exists() ? _global.get() : get_default_parameters();
       _gstate2 = _global2.exists() ? _global2.get() : eosio_global_state2{};
       _gstate3 = _global3.exists() ? _global3.get() : eosio_global_state3{};
+      _gstate4 = _global4.exists() ? _global4.get() : eosio_global_state4{};
       _contracts_version.set(version_info{CONTRACTS_VERSION}, _self);
    }
 
@@ -56,6 +61,13 @@ namespace eosiosystem {
       _global.set( _gstate, _self );
       _global2.set( _gstate2, _self );
       _global3.set( _gstate3, _self );
+      _global4.set( _gstate4, _self );
+      if( _ecache_dirty ) {
+         _electcache.set( *_ecache, _self );
+      }
+#ifdef EOSIO_SYSTEM_INSTRUMENTATION
+      instrumentation::counters().print();
+#endif
    }
 
    void system_contract::setram( uint64_t max_ram_size ) {
@@ -117,6 +129,23 @@ namespace eosiosystem {
       set_blockchain_parameters( params );
    }
 
+   void system_contract::setprodorder( uint8_t order ) {
+      require_auth( _self );
+      check( order <= static_cast<uint8_t>(schedule_order_type::by_location), "unknown schedule order" );
+      _gstate4.schedule_order = order;
+   }
+
+   void system_contract::setschedsize( uint8_t strategy, uint16_t step, uint16_t band, uint8_t gain ) {
+      require_auth( _self );
+      check( strategy <= static_cast<uint8_t>(voting_math::schedule_size_strategy_type::proportional), "unknown schedule size strategy" );
+      check( 0 < step, "step must be positive" );
+      check( gain <= 100, "gain must not exceed 100 percent" );
+      _gstate4.schedule_size_strategy = strategy;
+      _gstate.schedule_size_step      = step;
+      _gstate4.schedule_size_band     = band;
+      _gstate4.schedule_size_gain     = gain;
+   }
+
    void system_contract::setpriv( name account, uint8_t ispriv ) {
       require_auth( _self );
       set_privileged( account.value, ispriv );
@@ -277,9 +306,12 @@ namespace eosiosystem {
       require_auth( _self );
       auto prod = _producers.find( producer.value );
       check( prod != _producers.end(), "producer not found" );
+      const double scale = producer_scale( *prod );
       _producers.modify( prod, same_payer, [&](auto& p) {
             p.deactivate();
          });
+      place_producer( *prod, scale );
+      update_election_cache( *prod );
    }
 
    void system_contract::updtrevision( uint8_t revision ) {
@@ -344,6 +376,7 @@ namespace eosiosystem {
          t.delay_sec = 0;
          uint128_t deferred_id = (uint128_t(newname.value) << 64) | current->high_bidder.value;
          cancel_deferred( deferred_id );
+         SYSTEM_COUNT( deferred );
          t.send( deferred_id, bidder );
 
          bids.modify( current, bidder, [&]( auto& b ) {
@@ -448,6 +481,11 @@ namespace eosiosystem {
          m.quote.balance.amount = system_token_supply.amount / 1000;
          m.quote.balance.symbol = core;
       });
+
+      /// a contract initialized before any stake has no proxy followers and no earlier votes to index
+      const bool no_voters = _voters.begin() == _voters.end();
+      _gstate4.proxy_index_complete   = no_voters;
+      _gstate4.vote_activity_complete = no_voters;
    }
 
 } /// eosio.system
@@ -457,12 +495,17 @@ EOSIO_DISPATCH( eosiosystem::system_contract,
      // native.hpp (newaccount definition is actually in eosio.system.cpp)
      (newaccount)(updateauth)(deleteauth)(linkauth)(unlinkauth)(canceldelay)(onerror)(setabi)
      // eosio.system.cpp
-     (init)(setram)(setramrate)(setparams)(setpriv)(setalimits)(setacctram)(setacctnet)(setacctcpu)
+     (init)(setram)(setramrate)(setparams)(setprodorder)(setschedsize)(setpriv)(setalimits)(setacctram)(setacctnet)(setacctcpu)
      (rmvproducer)(updtrevision)(bidname)(bidrefund)
      // delegate_bandwidth.cpp
      (buyrambytes)(buyram)(sellram)(delegatebw)(undelegatebw)(refund)
      // voting.cpp
-     (regproducer)(unregprod)(voteproducer)(regproxy)
+     (regproducer)(unregprod)(voteproducer)(regproxy)(rebuildelect)(rescalevote)(setvoteexp)(expirevotes)(setvoteprop)
+     (indexvoteact)
+     // proxies.cpp
+     (indexproxies)(rebuildproxy)
      // producer_pay.cpp
-     (onblock)(claimrewards)
+     (onblock)(claimrewards)(bulkclaim)(setautopay)(autopayout)(setpaybatch)(fillbuckets)
+     // maintenance.cpp
+     (settask)(setmaintbudg)
 )
@@ -0,0 +1,132 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#include <eosio.system/eosio.system.hpp>
+
+#include <eosiolib/eosio.hpp>
+#include <eosiolib/multi_index.hpp>
+
+#include <algorithm>
+#include <limits>
+
+namespace eosiosystem {
+
+   /// batched work that can be spread over blocks, each entry continues where its previous run stopped
+   static constexpr name maintenance_tasks[] = {
+      "rescalevote"_n,  ///< rescale_votes
+      "expirevotes"_n,  ///< expire_stale_votes
+      "indexvoteact"_n, ///< index_vote_activity
+      "flushvotes"_n,   ///< flush_pending_votes
+      "indexproxies"_n, ///< index_proxies
+      "autopay"_n,      ///< autopay_producers
+      "emission"_n      ///< send_bucket_fill, the batch size does not matter
+   };
+
+   void system_contract::settask( const name task, uint32_t interval, uint16_t batch_size ) {
+      require_auth( _self );
+      check( std::find( std::begin(maintenance_tasks), std::end(maintenance_tasks), task ) != std::end(maintenance_tasks),
+             "unknown maintenance task" );
+
+      maintenance_task_table tasks( _self, _self.value );
+      auto itr = tasks.find( task.value );
+      if( interval == 0 ) {
+         check( itr != tasks.end(), "task is not scheduled" );
+         tasks.erase( itr );
+      } else {
+         check( 0 < batch_size, "batch_size must be positive" );
+         const uint32_t next_slot = current_block_time().slot;
+         if( itr == tasks.end() ) {
+            tasks.emplace( _self, [&]( auto& t ) {
+               t.task       = task;
+               t.interval   = interval;
+               t.batch_size = batch_size;
+               t.next_slot  = next_slot;
+            });
+         } else {
+            tasks.modify( itr, same_payer, [&]( auto& t ) {
+               t.interval   = interval;
+               t.batch_size = batch_size;
+               t.next_slot  = next_slot;
+            });
+         }
+      }
+      update_emission_streaming( tasks );
+      update_next_maintenance_slot( tasks );
+   }
+
+   void system_contract::setmaintbudg( uint32_t budget ) {
+      require_auth( _self );
+      _gstate4.maintenance_budget = budget;
+      update_emission_streaming( maintenance_task_table( _self, _self.value ) );
+   }
+
+   /**
+    *  Claims only settle against the pay buckets while the emission task is scheduled and has a budget to run with,
+    *  otherwise they fill the buckets themselves.
+    */
+   void system_contract::update_emission_streaming( const maintenance_task_table& tasks ) {
+      _gstate4.emission_streaming = _gstate4.maintenance_budget > 0 && tasks.find( "emission"_n.value ) != tasks.end();
+   }
+
+   /**
+    *  Runs the due maintenance tasks until the rows granted to them exhaust the block budget. Tasks are visited
+    *  round robin from the one after the task run last, so that a small budget does not starve the later tasks.
+    *  Blocks before the earliest due slot do not read the tasks table.
+    *
+    *  A failing task fails onblock along with the schedule update before it. The batched steps return where their
+    *  actions fail with "action has no effect" and only check for data corruption, payouts are sent deferred.
+    */
+   void system_contract::run_maintenance( block_timestamp timestamp ) {
+      if( _gstate4.maintenance_budget == 0 || timestamp.slot < _gstate4.next_maintenance_slot ) {
+         return;
+      }
+
+      maintenance_task_table tasks( _self, _self.value );
+      uint32_t budget  = _gstate4.maintenance_budget;
+      const name start = _gstate4.maintenance_cursor;
+      for( int pass = 0; pass < 2 && budget > 0; ++pass ) {
+         for( auto itr = pass == 0 ? tasks.upper_bound( start.value ) : tasks.begin();
+              itr != tasks.end() && budget > 0 && ( pass == 0 || itr->task <= start ); ++itr ) {
+            if( timestamp.slot < itr->next_slot ) {
+               continue;
+            }
+            const uint32_t rows = std::min<uint32_t>( itr->batch_size, budget );
+            budget -= rows;
+            _gstate4.maintenance_cursor = itr->task;
+            tasks.modify( itr, same_payer, [&]( auto& t ) {
+               t.next_slot = timestamp.slot + t.interval;
+            });
+            run_maintenance_task( itr->task, rows );
+         }
+      }
+      update_next_maintenance_slot( tasks );
+   }
+
+   void system_contract::run_maintenance_task( const name task, uint32_t max_rows ) {
+      if( task == "rescalevote"_n ) {
+         rescale_votes( max_rows );
+      } else if( task == "expirevotes"_n ) {
+         expire_stale_votes( max_rows );
+      } else if( task == "indexvoteact"_n ) {
+         index_vote_activity( max_rows );
+      } else if( task == "flushvotes"_n ) {
+         flush_pending_votes( max_rows );
+      } else if( task == "indexproxies"_n ) {
+         index_proxies( max_rows );
+      } else if( task == "autopay"_n ) {
+         autopay_producers( static_cast<uint16_t>( std::min<uint32_t>( max_rows, std::numeric_limits<uint16_t>::max() ) ) );
+      } else if( task == "emission"_n ) {
+         send_bucket_fill();
+      }
+   }
+
+   void system_contract::update_next_maintenance_slot( const maintenance_task_table& tasks ) {
+      uint32_t next_slot = std::numeric_limits<uint32_t>::max();
+      for( const auto& t : tasks ) {
+         next_slot = std::min( next_slot, t.next_slot );
+      }
+      _gstate4.next_maintenance_slot = next_slot;
+   }
+
+} /// namespace eosiosystem
@@ -1,13 +1,17 @@
 #include <eosio.system/eosio.system.hpp>
+#include <eosio.system/emission.hpp>
 
 #include <eosio.token/eosio.token.hpp>
-#include <cmath>
+
+#include <eosiolib/transaction.hpp>
+
+#include <algorithm>
+#include <tuple>
 
 namespace eosiosystem {
 
    const int64_t  min_pervote_daily_pay = 100'0000;
    const int64_t  min_activated_stake   = 25'090'624'0000;
-   const double   continuous_rate       = 0.04879;          // 5% annual rate
    const double   perblock_rate         = 0.0025;           // 0.25%
    const double   standby_rate          = 0.0075;           // 0.75%
    const uint32_t blocks_per_year       = 52*7*24*2*3600;   // half seconds per year
@@ -53,7 +57,10 @@ namespace eosiosystem {
 
       /// only update block producers once every minute, block_timestamp is in half seconds
       if( timestamp.slot - _gstate.last_producer_schedule_update.slot > 120 ) {
+         flush_pending_votes( _gstate4.vote_flush_batch_size );
+         update_target_schedule_size( timestamp );
          update_elected_producers( timestamp );
+         autopay_producers( _gstate4.autopay_batch_size );
 
          if( (timestamp.slot - _gstate.last_name_close.slot) > blocks_per_day ) {
             name_bid_table bids(_self, _self.value);
@@ -72,43 +79,28 @@ namespace eosiosystem {
             }
          }
       }
-   }
-
-   using namespace eosio;
-
-   double get_target_emission_per_year(double activated_share) {
-      if (activated_share <= 0.33) {
-         return 0.2;
-      } else if (activated_share >= 0.66) {
-         return 0.1;
-      }
-      return -10. / 33 * (activated_share - 0.33) + 0.2;
-   }
 
-   double get_continuous_rate(double emission_rate) {
-         return (pow(1 + emission_rate, 1./blocks_per_hour) - 1) * blocks_per_hour;
+      /// the schedule update comes first, so that it neither waits for the budget nor depends on the tasks
+      run_maintenance( timestamp );
    }
 
-   void system_contract::claimrewards( const name owner ) {
-      require_auth( owner );
-
-      const auto& prod = _producers.get( owner.value );
-      check( prod.active(), "producer does not have an active key" );
-
-      check( _gstate.total_activated_stake >= min_activated_stake,
-                    "cannot claim rewards until the chain is activated (at least 15% of all tokens participate in voting)" );
-
-      const auto ct = current_time_point();
-
-      check( ct - prod.last_claim_time > microseconds(useconds_per_day), "already claimed rewards within past day" );
+   using namespace eosio;
 
-      const asset token_supply   = eosio::token::get_supply(token_account, core_symbol().code() );
+   /**
+    *  Issues the emission since the last fill and funds the DAO and the pay buckets with it. The fill time only
+    *  moves on when tokens were issued, so short intervals of the emission stream accumulate instead of rounding
+    *  down to nothing. The emission stops at the maximum supply instead of failing the issue.
+    */
+   void system_contract::fill_pay_buckets( time_point ct ) {
       const auto usecs_since_last_fill = (ct - _gstate.last_pervote_bucket_fill).count();
 
       if( usecs_since_last_fill > 0 && _gstate.last_pervote_bucket_fill > time_point() ) {
-         double emission_rate = get_target_emission_per_year(1.0 * _gstate.active_stake / token_supply.amount);
-         double continuous_rate = get_continuous_rate(emission_rate);
-         auto new_tokens = static_cast<int64_t>(continuous_rate * token_supply.amount * usecs_since_last_fill / useconds_per_year);
+         const asset token_supply = eosio::token::get_supply(token_account, core_symbol().code() );
+         const int64_t rate = emission::get_continuous_rate( _gstate.active_stake, token_supply.amount );
+         const int64_t available = eosio::token::get_max_supply(token_account, core_symbol().code() ).amount - token_supply.amount;
+         auto new_tokens = std::min<int64_t>( emission::get_emission( rate, token_supply.amount, usecs_since_last_fill ), available );
+         if( new_tokens <= 0 )
+            return;
          auto to_dao     = new_tokens / 5;
          auto to_producers  = new_tokens - to_dao;
          auto to_per_block_pay = to_producers / 4;
@@ -119,15 +111,19 @@ namespace eosiosystem {
             { _self, asset(new_tokens, core_symbol()), std::string("issue tokens for producer pay and DAO") }
          );
 
-         INLINE_ACTION_SENDER(eosio::token, transfer)(
-            token_account, { {_self, active_permission} },
-            { _self, saving_account, asset(to_dao, core_symbol()), "reward for DAO" }
-         );
+         if( to_dao > 0 ) {
+            INLINE_ACTION_SENDER(eosio::token, transfer)(
+               token_account, { {_self, active_permission} },
+               { _self, saving_account, asset(to_dao, core_symbol()), "reward for DAO" }
+            );
+         }
 
-         INLINE_ACTION_SENDER(eosio::token, transfer)(
-            token_account, { {_self, active_permission} },
-            { _self, bpay_account, asset(to_per_block_pay, core_symbol()), "fund per-block bucket" }
-         );
+         if( to_per_block_pay > 0 ) {
+            INLINE_ACTION_SENDER(eosio::token, transfer)(
+               token_account, { {_self, active_permission} },
+               { _self, bpay_account, asset(to_per_block_pay, core_symbol()), "fund per-block bucket" }
+            );
+         }
 
          INLINE_ACTION_SENDER(eosio::token, transfer)(
             token_account, { {_self, active_permission} },
@@ -138,7 +134,64 @@ namespace eosiosystem {
          _gstate.perblock_bucket         += to_per_block_pay;
          _gstate.last_pervote_bucket_fill = ct;
       }
+   }
+
+   void system_contract::fillbuckets() {
+      require_auth( _self );
+      fill_pay_buckets( current_time_point() );
+   }
+
+   /**
+    *  Sends the bucket fill of the emission task in a transaction of its own, so that a failing issue or transfer
+    *  only fails the fill and not onblock. The fill time does not move then and the next run catches up.
+    *  No account bids on the name of the contract, so the id does not collide with the bid refunds.
+    */
+   void system_contract::send_bucket_fill() {
+      transaction t;
+      t.actions.emplace_back( permission_level{_self, active_permission},
+                              _self, "fillbuckets"_n,
+                              std::make_tuple()
+      );
+      t.delay_sec = 0;
+      uint128_t deferred_id = (uint128_t(_self.value) << 64) | "fillbuckets"_n.value;
+      cancel_deferred( deferred_id );
+      SYSTEM_COUNT( deferred );
+      t.send( deferred_id, _self );
+   }
+
+   /**
+    *  Claims fill the buckets themselves unless the emission maintenance task streams the emission into them.
+    */
+   void system_contract::fill_pay_buckets_on_claim( time_point ct ) {
+      if( !_gstate4.emission_streaming ) {
+         fill_pay_buckets( ct );
+      }
+   }
 
+   /**
+    *  Captures the buckets and the totals the pay is shared against. Paying a producer takes its share out of the
+    *  bucket and the total alike, so the later producers of a batch are paid against the captured totals. A producer
+    *  whose vote pay falls below min_pervote_daily_pay leaves its pay in the bucket: settle_producer_pay removes its
+    *  share from the captured total, as a claim of its own would, so the batch pays the same as claims one after
+    *  another up to the rounding of the individual amounts.
+    */
+   pay_snapshot system_contract::take_pay_snapshot( time_point ct ) {
+      pay_snapshot snapshot;
+      snapshot.perblock_bucket     = _gstate.perblock_bucket;
+      snapshot.pervote_bucket      = _gstate.pervote_bucket;
+      snapshot.total_unpaid_blocks = _gstate.total_unpaid_blocks;
+      if( _gstate2.revision > 0 ) {
+         snapshot.total_votepay_share = update_total_votepay_share( ct );
+      }
+      return snapshot;
+   }
+
+   /**
+    *  Computes per-block and per-vote pay of the producer, takes it out of the buckets and resets the producer's
+    *  unpaid blocks and votepay share. Buckets must be filled up to `ct` before the snapshot is taken.
+    */
+   producer_payout system_contract::settle_producer_pay( const producer_info& prod, time_point ct, pay_snapshot& snapshot ) {
+      const name owner = prod.owner;
       auto prod2 = _producers2.find( owner.value );
 
       /// New metric to be used in pervote pay calculation. Instead of vote weight ratio, we combine vote weight and
@@ -162,57 +215,249 @@ namespace eosiosystem {
       // In fact it is desired behavior because the producers votes need to be counted in the global total_producer_votepay_share for the first time.
 
       int64_t producer_per_block_pay = 0;
-      if( _gstate.total_unpaid_blocks > 0 ) {
-         producer_per_block_pay = (_gstate.perblock_bucket * prod.unpaid_blocks) / _gstate.total_unpaid_blocks;
+      if( snapshot.total_unpaid_blocks > 0 ) {
+         producer_per_block_pay = (snapshot.perblock_bucket * prod.unpaid_blocks) / snapshot.total_unpaid_blocks;
       }
 
-      double new_votepay_share = update_producer_votepay_share( prod2,
-                                    ct,
-                                    updated_after_threshold ? 0.0 : prod.total_votes,
-                                    true // reset votepay_share to zero after updating
-                                 );
+      double new_votepay_share = settle_producer_votepay_share( prod, prod2, ct, !updated_after_threshold );
 
       int64_t producer_per_vote_pay = 0;
       if( _gstate2.revision > 0 ) {
-         double total_votepay_share = update_total_votepay_share( ct );
-         if( total_votepay_share > 0 && !crossed_threshold ) {
-            producer_per_vote_pay = int64_t((new_votepay_share * _gstate.pervote_bucket) / total_votepay_share);
-            if( producer_per_vote_pay > _gstate.pervote_bucket )
-               producer_per_vote_pay = _gstate.pervote_bucket;
+         if( snapshot.total_votepay_share > 0 && !crossed_threshold ) {
+            producer_per_vote_pay = int64_t((new_votepay_share * snapshot.pervote_bucket) / snapshot.total_votepay_share);
          }
       } else {
          if( _gstate.total_producer_vote_weight > 0 ) {
-            producer_per_vote_pay = int64_t((_gstate.pervote_bucket * prod.total_votes) / _gstate.total_producer_vote_weight);
+            producer_per_vote_pay = int64_t((snapshot.pervote_bucket * producer_votes( prod )) / _gstate.total_producer_vote_weight);
          }
       }
 
       if( producer_per_vote_pay < min_pervote_daily_pay ) {
          producer_per_vote_pay = 0;
+         /// the unpaid vote pay stays in the bucket for the rest of the batch, the share of the producer does not
+         snapshot.total_votepay_share = std::max( snapshot.total_votepay_share - new_votepay_share, 0.0 );
+      }
+      if( producer_per_block_pay > _gstate.perblock_bucket ) {
+         producer_per_block_pay = _gstate.perblock_bucket;
+      }
+      if( producer_per_vote_pay > _gstate.pervote_bucket ) {
+         producer_per_vote_pay = _gstate.pervote_bucket;
       }
 
       _gstate.pervote_bucket      -= producer_per_vote_pay;
       _gstate.perblock_bucket     -= producer_per_block_pay;
       _gstate.total_unpaid_blocks -= prod.unpaid_blocks;
 
-      update_total_votepay_share( ct, -new_votepay_share, (updated_after_threshold ? prod.total_votes : 0.0) );
+      update_total_votepay_share( ct, -new_votepay_share, (updated_after_threshold ? producer_votes( prod ) : 0.0) );
 
       _producers.modify( prod, same_payer, [&](auto& p) {
          p.last_claim_time = ct;
          p.unpaid_blocks   = 0;
       });
+      set_votepay_offset( owner, 0.0 );
+
+      return producer_payout{ owner, producer_per_block_pay, producer_per_vote_pay };
+   }
+
+   /**
+    *  Pays a batch of producers. The token contract has no multi-recipient transfer, so the per-vote pay of the
+    *  whole batch is moved to the per-block pay account at once, then every producer gets a single transfer.
+    */
+   void system_contract::send_producer_pay( const std::vector<producer_payout>& payouts, bool owner_auth ) {
+      int64_t total_per_vote_pay = 0;
+      for( const auto& p : payouts ) {
+         total_per_vote_pay += p.per_vote_pay;
+      }
+
+      if( total_per_vote_pay > 0 ) {
+         INLINE_ACTION_SENDER(eosio::token, transfer)(
+            token_account, { {vpay_account, active_permission} },
+            { vpay_account, bpay_account, asset(total_per_vote_pay, core_symbol()), std::string("producer vote pay") }
+         );
+      }
+
+      for( const auto& p : payouts ) {
+         const int64_t amount = p.per_block_pay + p.per_vote_pay;
+         if( amount <= 0 )
+            continue;
+
+         std::vector<permission_level> auth{ {bpay_account, active_permission} };
+         if( owner_auth ) {
+            auth.emplace_back( p.owner, active_permission );
+         }
+         INLINE_ACTION_SENDER(eosio::token, transfer)(
+            token_account, auth,
+            { bpay_account, p.owner, asset(amount, core_symbol()), std::string("producer pay") }
+         );
+      }
+   }
+
+   void system_contract::claimrewards( const name owner ) {
+      require_auth( owner );
+
+      const auto& prod = _producers.get( owner.value );
+      check( prod.active(), "producer does not have an active key" );
+
+      check( _gstate.total_activated_stake >= min_activated_stake,
+                    "cannot claim rewards until the chain is activated (at least 15% of all tokens participate in voting)" );
+
+      const auto ct = current_time_point();
+
+      check( ct - prod.last_claim_time > microseconds(useconds_per_day), "already claimed rewards within past day" );
+
+      fill_pay_buckets_on_claim( ct );
+      auto snapshot = take_pay_snapshot( ct );
+      const auto payout = settle_producer_pay( prod, ct, snapshot );
 
-      if( producer_per_block_pay > 0 ) {
+      if( payout.per_block_pay > 0 ) {
          INLINE_ACTION_SENDER(eosio::token, transfer)(
             token_account, { {bpay_account, active_permission}, {owner, active_permission} },
-            { bpay_account, owner, asset(producer_per_block_pay, core_symbol()), std::string("producer block pay") }
+            { bpay_account, owner, asset(payout.per_block_pay, core_symbol()), std::string("producer block pay") }
          );
       }
-      if( producer_per_vote_pay > 0 ) {
+      if( payout.per_vote_pay > 0 ) {
          INLINE_ACTION_SENDER(eosio::token, transfer)(
             token_account, { {vpay_account, active_permission}, {owner, active_permission} },
-            { vpay_account, owner, asset(producer_per_vote_pay, core_symbol()), std::string("producer vote pay") }
+            { vpay_account, owner, asset(payout.per_vote_pay, core_symbol()), std::string("producer vote pay") }
          );
       }
    }
 
+   void system_contract::bulkclaim( const std::vector<name>& owners ) {
+      check( !owners.empty(), "no producers to claim rewards for" );
+      check( _gstate.total_activated_stake >= min_activated_stake,
+                    "cannot claim rewards until the chain is activated (at least 15% of all tokens participate in voting)" );
+
+      const auto ct = current_time_point();
+
+      for( size_t i = 0; i < owners.size(); ++i ) {
+         require_auth( owners[i] );
+         check( std::find( owners.begin(), owners.begin() + i, owners[i] ) == owners.begin() + i, "duplicate producer" );
+
+         const auto& prod = _producers.get( owners[i].value, "producer not found" );
+         check( prod.active(), "producer does not have an active key" );
+         check( ct - prod.last_claim_time > microseconds(useconds_per_day), "already claimed rewards within past day" );
+      }
+
+      fill_pay_buckets_on_claim( ct );
+      auto snapshot = take_pay_snapshot( ct );
+
+      std::vector<producer_payout> payouts;
+      payouts.reserve( owners.size() );
+      for( const auto& owner : owners ) {
+         payouts.push_back( settle_producer_pay( _producers.get( owner.value ), ct, snapshot ) );
+      }
+
+      send_producer_pay( payouts, true );
+   }
+
+   void system_contract::setautopay( const name producer, bool enabled ) {
+      require_auth( producer );
+
+      const auto& prod = _producers.get( producer.value, "producer not found" );
+      autopay_table autopay( _self, _self.value );
+      auto itr = autopay.find( producer.value );
+      if( enabled ) {
+         check( prod.active(), "producer does not have an active key" );
+         check( itr == autopay.end(), "automatic payouts are already enabled" );
+         autopay.emplace( producer, [&]( auto& a ) {
+            a.owner = producer;
+         });
+         /// the schedule updates settle the producer without its authority, so they must not create rows billed to it
+         if( _producers2.find( producer.value ) == _producers2.end() ) {
+            _producers2.emplace( producer, [&]( auto& info ) {
+               info.owner                     = producer;
+               info.last_votepay_share_update = current_time_point();
+            });
+         }
+      } else {
+         check( itr != autopay.end(), "automatic payouts are not enabled" );
+         send_producer_pay( { producer_payout{ producer, itr->per_block_pay, itr->per_vote_pay } }, true );
+         autopay.erase( itr );
+      }
+   }
+
+   void system_contract::autopayout( const name producer ) {
+      autopay_table autopay( _self, _self.value );
+      const auto& accrued = autopay.get( producer.value, "automatic payouts are not enabled" );
+      check( 0 < accrued.per_block_pay + accrued.per_vote_pay, "no accrued pay" );
+
+      send_producer_pay( { producer_payout{ producer, accrued.per_block_pay, accrued.per_vote_pay } }, false );
+      autopay.modify( accrued, same_payer, [&]( auto& a ) {
+         a.per_block_pay = 0;
+         a.per_vote_pay  = 0;
+      });
+   }
+
+   /**
+    *  Sends the accrued pay of `producer` in a transaction of its own. A producer account is never a bidder on
+    *  its own name, so the id does not collide with the bid refunds.
+    */
+   void system_contract::send_autopayout( const name producer ) {
+      transaction t;
+      t.actions.emplace_back( permission_level{_self, active_permission},
+                              _self, "autopayout"_n,
+                              producer
+      );
+      t.delay_sec = 0;
+      uint128_t deferred_id = (uint128_t(producer.value) << 64) | "autopayout"_n.value;
+      cancel_deferred( deferred_id );
+      SYSTEM_COUNT( deferred );
+      t.send( deferred_id, _self );
+   }
+
+   void system_contract::setpaybatch( uint16_t batch_size ) {
+      require_auth( _self );
+      _gstate4.autopay_batch_size = batch_size;
+   }
+
+   /**
+    *  Settles at most `batch_size` opted-in producers per call, continuing after the one settled last,
+    *  so payouts are spread over schedule updates instead of bunching up when the day of the last claim ends.
+    *
+    *  The pay is accrued on the autopay rows and sent by a deferred autopayout per producer: a transfer notifies
+    *  the producer account, and a producer rejecting the notification must only fail its own payout, not onblock.
+    */
+   void system_contract::autopay_producers( uint16_t batch_size ) {
+      autopay_table autopay( _self, _self.value );
+      if( batch_size == 0 || autopay.begin() == autopay.end() )
+         return;
+
+      const auto ct = current_time_point();
+      std::optional<pay_snapshot> snapshot;
+
+      auto itr = autopay.upper_bound( _gstate4.autopay_cursor.value );
+      std::optional<name> first;
+      for( uint16_t i = 0; i < batch_size; ++i ) {
+         if( itr == autopay.end() ) {
+            itr = autopay.begin();
+         }
+         if( first && *first == itr->owner ) {
+            break; // fewer opted-in producers than the batch size
+         }
+         if( !first ) {
+            first = itr->owner;
+         }
+         _gstate4.autopay_cursor = itr->owner;
+
+         const auto& prod = _producers.get( itr->owner.value, "producer not found" ); // data corruption
+         if( prod.active() && ct - prod.last_claim_time > microseconds(useconds_per_day)
+             && _producers2.find( itr->owner.value ) != _producers2.end() ) {
+            if( !snapshot ) {
+               fill_pay_buckets_on_claim( ct );
+               snapshot = take_pay_snapshot( ct );
+            }
+            const auto payout = settle_producer_pay( prod, ct, *snapshot );
+            autopay.modify( itr, same_payer, [&]( auto& a ) {
+               a.per_block_pay += payout.per_block_pay;
+               a.per_vote_pay  += payout.per_vote_pay;
+            });
+            if( 0 < itr->per_block_pay + itr->per_vote_pay ) {
+               send_autopayout( itr->owner );
+            }
+         }
+         ++itr;
+      }
+   }
+
 } //namespace eosiosystem
@@ -0,0 +1,183 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#include <eosio.system/eosio.system.hpp>
+#include <eosio.system/voting_math.hpp>
+
+#include <eosiolib/eosio.hpp>
+#include <eosiolib/multi_index.hpp>
+
+namespace eosiosystem {
+
+   /**
+    *  Moves `voter` from the followers of `old_proxy` to the followers of its current proxy and keeps the staked
+    *  amount of its follower row and the aggregates of the proxy up to date. Index rows are billed to the contract.
+    */
+   void system_contract::update_proxy_follower( const voter_info& voter, const name old_proxy ) {
+      if( old_proxy && old_proxy != voter.proxy ) {
+         remove_proxy_follower( old_proxy, voter.owner );
+      }
+      if( !voter.proxy ) {
+         return;
+      }
+
+      proxy_follower_table followers( _self, voter.proxy.value );
+      auto itr = followers.find( voter.owner.value );
+      if( itr == followers.end() ) {
+         followers.emplace( _self, [&]( auto& f ) {
+            f.owner  = voter.owner;
+            f.staked = voter.staked;
+         });
+         update_proxy_stats( voter.proxy, 1, voter.staked );
+      } else if( itr->staked != voter.staked ) {
+         const int64_t delta = voter.staked - itr->staked;
+         followers.modify( itr, same_payer, [&]( auto& f ) {
+            f.staked = voter.staked;
+         });
+         update_proxy_stats( voter.proxy, 0, delta );
+      }
+   }
+
+   void system_contract::remove_proxy_follower( const name proxy, const name follower ) {
+      proxy_follower_table followers( _self, proxy.value );
+      auto itr = followers.find( follower.value );
+      if( itr != followers.end() ) {
+         update_proxy_stats( proxy, -1, -itr->staked );
+         followers.erase( itr );
+      }
+   }
+
+   /**
+    *  The aggregates of a proxy are removed with its last follower unless a rebuild is running.
+    */
+   void system_contract::update_proxy_stats( const name proxy, int32_t followers_delta, int64_t staked_delta ) {
+      proxy_stats_table stats( _self, _self.value );
+      auto itr = stats.find( proxy.value );
+      if( itr == stats.end() ) {
+         check( 0 <= followers_delta, "proxy aggregates not found" ); //data corruption
+         stats.emplace( _self, [&]( auto& s ) {
+            s.owner     = proxy;
+            s.followers = followers_delta;
+            s.staked    = staked_delta;
+         });
+      } else if( itr->followers + followers_delta == 0 && !itr->rebuilding ) {
+         stats.erase( itr );
+      } else {
+         stats.modify( itr, same_payer, [&]( auto& s ) {
+            s.followers += followers_delta;
+            s.staked    += staked_delta;
+         });
+      }
+   }
+
+   /**
+    *  Adds a change of the vote weight of `follower` to the running rebuild of `proxy` if the rebuild already
+    *  summed the follower up, the followers after the cursor are read with their current weight.
+    */
+   void system_contract::track_proxy_rebuild( const name proxy, const name follower, double weight_delta ) {
+      proxy_stats_table stats( _self, _self.value );
+      auto itr = stats.find( proxy.value );
+      if( itr == stats.end() || !itr->rebuilding || itr->rebuild_cursor < follower ) {
+         return;
+      }
+      stats.modify( itr, same_payer, [&]( auto& s ) {
+         s.rebuild_weight += weight_delta * voting_math::epoch_scale( _gstate4.vote_epoch, s.rebuild_epoch );
+      });
+   }
+
+   /**
+    *  Indexes the followers among at most `max_rows` voters after the cursor.
+    *
+    *  @return false if the index was already complete
+    */
+   bool system_contract::index_proxies( uint32_t max_rows ) {
+      if( _gstate4.proxy_index_complete ) {
+         return false;
+      }
+
+      auto itr = _voters.upper_bound( _gstate4.proxy_index_cursor.value );
+      for( uint32_t rows = 0; rows < max_rows && itr != _voters.end(); ++rows, ++itr ) {
+         if( itr->proxy ) {
+            update_proxy_follower( *itr, itr->proxy );
+         }
+         _gstate4.proxy_index_cursor = itr->owner;
+      }
+      if( itr == _voters.end() ) {
+         _gstate4.proxy_index_cursor   = name();
+         _gstate4.proxy_index_complete = true;
+      }
+      return true;
+   }
+
+   void system_contract::indexproxies( uint32_t max_rows ) {
+      check( 0 < max_rows, "max_rows must be positive" );
+      check( index_proxies( max_rows ), "action has no effect" );
+   }
+
+   /**
+    *  Sums up the last vote weights of the followers of `proxy` in the epoch the rebuild started in. Small
+    *  changes dropped before they were held back as pending votes left proxied_vote_weight off this sum.
+    *  Aggregates only exist for proxies with followers, the rebuild never creates them.
+    */
+   void system_contract::rebuildproxy( const name proxy, uint32_t max_rows ) {
+      check( 0 < max_rows, "max_rows must be positive" );
+      check( _gstate4.proxy_index_complete, "proxy index is not complete" );
+      const auto& pitr = _voters.get( proxy.value, "proxy not found" );
+      check( pitr.is_proxy, "account is not a proxy" );
+
+      proxy_stats_table stats( _self, _self.value );
+      auto sitr = stats.find( proxy.value );
+      if( sitr == stats.end() ) {
+         _voters.modify( pitr, same_payer, [&]( auto& p ) {
+            p.rescale( _gstate4.vote_epoch );
+            p.proxied_vote_weight = 0;
+         });
+         propagate_weight_change( pitr );
+         return;
+      }
+      if( !sitr->rebuilding ) {
+         stats.modify( sitr, same_payer, [&]( auto& s ) {
+            s.rebuilding     = true;
+            s.rebuild_cursor = name();
+            s.rebuild_weight = 0;
+            s.rebuild_epoch  = _gstate4.vote_epoch;
+         });
+      }
+
+      proxy_follower_table followers( _self, proxy.value );
+      auto itr = followers.upper_bound( sitr->rebuild_cursor.value );
+      name cursor   = sitr->rebuild_cursor;
+      double weight = sitr->rebuild_weight;
+      for( uint32_t rows = 0; rows < max_rows && itr != followers.end(); ++rows, ++itr ) {
+         const auto& v = _voters.get( itr->owner.value, "follower not found" ); //data corruption
+         weight += v.last_vote_weight * voting_math::epoch_scale( v.vote_epoch, sitr->rebuild_epoch );
+         cursor = itr->owner;
+      }
+
+      if( itr != followers.end() ) {
+         stats.modify( sitr, same_payer, [&]( auto& s ) {
+            s.rebuild_cursor = cursor;
+            s.rebuild_weight = weight;
+         });
+         return;
+      }
+
+      const double proxied = weight * voting_math::epoch_scale( sitr->rebuild_epoch, _gstate4.vote_epoch );
+      if( sitr->followers == 0 ) {
+         stats.erase( sitr );
+      } else {
+         stats.modify( sitr, same_payer, [&]( auto& s ) {
+            s.rebuilding     = false;
+            s.rebuild_cursor = name();
+            s.rebuild_weight = 0;
+         });
+      }
+      _voters.modify( pitr, same_payer, [&]( auto& p ) {
+         p.rescale( _gstate4.vote_epoch );
+         p.proxied_vote_weight = proxied;
+      });
+      propagate_weight_change( pitr );
+   }
+
+} /// namespace eosiosystem
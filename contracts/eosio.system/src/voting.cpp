@@ -3,6 +3,7 @@
  *  @copyright defined in eos/LICENSE.txt
  */
 #include <eosio.system/eosio.system.hpp>
+#include <eosio.system/voting_math.hpp>
 
 #include <eosiolib/eosio.hpp>
 #include <eosiolib/crypto.h>
@@ -16,6 +17,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <tuple>
 
 namespace eosiosystem {
    using eosio::indexed_by;
@@ -40,6 +42,8 @@ namespace eosiosystem {
       const auto ct = current_time_point();
 
       if ( prod != _producers.end() ) {
+         auto prod2 = _producers2.find( producer.value );
+         const double scale = producer_scale( *prod );
          _producers.modify( prod, producer, [&]( producer_info& info ){
             info.producer_key = producer_key;
             info.is_active    = true;
@@ -49,15 +53,20 @@ namespace eosiosystem {
                info.last_claim_time = ct;
          });
 
-         auto prod2 = _producers2.find( producer.value );
          if ( prod2 == _producers2.end() ) {
             _producers2.emplace( producer, [&]( producer_info2& info ){
                info.owner                     = producer;
                info.last_votepay_share_update = ct;
             });
-            update_total_votepay_share( ct, 0.0, prod->total_votes );
+            set_votepay_offset( producer, 0.0 ); // accrual starts over with the new producers2 row
+         }
+         place_producer( *prod, scale );
+         if ( prod2 == _producers2.end() ) {
+            update_total_votepay_share( ct, 0.0, producer_votes( *prod ) );
             // When introducing the producer2 table row for the first time, the producer's votes must also be accounted for in the global total_producer_votepay_share at the same time.
          }
+
+         update_election_cache( *prod );
       } else {
          _producers.emplace( producer, [&]( producer_info& info ){
             info.owner           = producer;
@@ -80,60 +89,234 @@ namespace eosiosystem {
       require_auth( producer );
 
       const auto& prod = _producers.get( producer.value, "producer not found" );
+      const double scale = producer_scale( prod );
       _producers.modify( prod, same_payer, [&]( producer_info& info ){
          info.deactivate();
       });
+      place_producer( prod, scale );
+      update_election_cache( prod );
    }
 
-   int32_t get_target_amount(int32_t activated_share) {
-      if (activated_share <= 33) {
-        return 21;
-      } else if (activated_share > 33 && activated_share < 60) {
-        return 21 + (activated_share - 33) * 3;
+   election_cache* system_contract::get_election_cache() {
+      if( !_ecache ) {
+         if( !_electcache.exists() )
+            return nullptr;
+         _ecache = _electcache.get();
       }
-      return 102;
+      return &*_ecache;
    }
 
-   void system_contract::update_elected_producers( block_timestamp block_time ) {
-      _gstate.last_producer_schedule_update = block_time;
+   /// same order as in the "prototalvote" index: by votes descending, ties by owner
+   static bool ranks_before( double a_votes, name a, double b_votes, name b ) {
+      return a_votes > b_votes || (a_votes == b_votes && a < b);
+   }
+
+   /**
+    *  Must be called after every change of total_votes, is_active, producer_key or location of a producer.
+    *
+    *  The cache is only rewritten when the membership, the order or the key or location of a candidate change.
+    *  A vote change which leaves the rank of a candidate as it is does not touch the cache, so the total_votes of
+    *  the candidates may lag behind the producers table. A candidate that moves is walked from its old rank to
+    *  its new one, only the candidates it passes are read back from the producers table.
+    */
+   void system_contract::update_election_cache( const producer_info& prod ) {
+      auto cache = get_election_cache();
+      if( !cache ) {
+         return; // the cache is built from scratch on the next schedule update
+      }
+
+      auto& candidates = cache->candidates;
+      auto itr = std::find_if( candidates.begin(), candidates.end(), [&]( const auto& c ) { return c.owner == prod.owner; } );
+      const double votes    = producer_votes( prod );
+      const bool   eligible = prod.active() && 0 < votes;
+      if( itr == candidates.end() ) {
+         if( !eligible || (candidates.size() >= cache->capacity && votes <= cache->max_excluded_votes) ) {
+            return;
+         }
+      } else if( eligible && itr->producer_key == prod.producer_key && itr->location == prod.location ) {
+         /// the neighbours are compared by their current votes, which keeps the order of the candidates exact
+         const auto keeps_rank = [&]() {
+            if( itr != candidates.begin() ) {
+               const auto& prev = *std::prev( itr );
+               if( !ranks_before( producer_votes( _producers.get( prev.owner.value ) ), prev.owner, votes, prod.owner ) )
+                  return false;
+            }
+            if( std::next( itr ) != candidates.end() ) {
+               const auto& next = *std::next( itr );
+               if( !ranks_before( votes, prod.owner, producer_votes( _producers.get( next.owner.value ) ), next.owner ) )
+                  return false;
+            }
+            return true;
+         };
+         if( keeps_rank() ) {
+            return;
+         }
+      }
+
+      /// new candidates start from the bottom, members from their old rank
+      size_t pos = candidates.size();
+      if( itr != candidates.end() ) {
+         pos = itr - candidates.begin();
+         candidates.erase( itr );
+      }
+      _ecache_dirty = true;
+      if( !eligible ) {
+         return;
+      }
+
+      const auto current_votes = [&]( elected_candidate& c ) {
+         c.total_votes = producer_votes( _producers.get( c.owner.value, "producer not found" ) ); //data corruption
+         return c.total_votes;
+      };
+      const size_t old_pos = pos;
+      while( 0 < pos && !ranks_before( current_votes( candidates[pos - 1] ), candidates[pos - 1].owner, votes, prod.owner ) ) {
+         --pos;
+      }
+      if( pos == old_pos ) {
+         while( pos < candidates.size() && ranks_before( current_votes( candidates[pos] ), candidates[pos].owner, votes, prod.owner ) ) {
+            ++pos;
+         }
+      }
+
+      if( pos < cache->capacity ) {
+         candidates.insert( candidates.begin() + pos, elected_candidate{ prod.owner, votes, prod.producer_key, prod.location } );
+         if( candidates.size() > cache->capacity ) {
+            cache->max_excluded_votes = std::max( cache->max_excluded_votes, current_votes( candidates.back() ) );
+            candidates.pop_back();
+         }
+      } else {
+         cache->max_excluded_votes = std::max( cache->max_excluded_votes, votes );
+      }
+   }
+
+   void system_contract::rebuild_election_cache() {
+      election_cache cache;
+      cache.capacity = _gstate.target_producer_schedule_size + election_cache_margin;
+      cache.candidates.reserve( cache.capacity );
 
       auto idx = _producers.get_index<"prototalvote"_n>();
+      for( auto it = idx.cbegin(); it != idx.cend() && 0 < it->total_votes && it->active(); ++it ) {
+         if( cache.candidates.size() == cache.capacity ) {
+            cache.max_excluded_votes = producer_votes( *it );
+            break;
+         }
+         cache.candidates.emplace_back( elected_candidate{ it->owner, producer_votes( *it ), it->producer_key, it->location } );
+      }
 
-      std::vector< std::pair<eosio::producer_key,uint16_t> > top_producers;
+      _ecache = std::move( cache );
+      _ecache_dirty = true;
+   }
+
+   void system_contract::rebuildelect() {
+      require_auth( _self );
+      rebuild_election_cache();
+   }
+
+   /**
+    *  Moves the target schedule size towards the amount for the activated share once every
+    *  2 * schedule_update_interval slots. The schedule updates in between neither read the token supply nor
+    *  evaluate the strategy.
+    */
+   void system_contract::update_target_schedule_size( block_timestamp block_time ) {
+      if( block_time.slot - _gstate.last_target_schedule_size_update.slot < 2 * _gstate.schedule_update_interval ) {
+         return;
+      }
       const asset token_supply = eosio::token::get_supply(token_account, core_symbol().code() );
       int32_t activated_share = 100 * _gstate.active_stake / token_supply.amount;
-      int32_t target_schedule_size = _gstate.target_producer_schedule_size;
+      int32_t target_amount = voting_math::get_target_amount(activated_share);
 
-      if (block_time.slot - _gstate.last_target_schedule_size_update.slot >= 2 * _gstate.schedule_update_interval) {
-        int32_t target_amount = get_target_amount(activated_share);
-        if (target_amount > target_schedule_size) {
-          target_schedule_size = target_schedule_size + _gstate.schedule_size_step;
-        } else if (target_amount < target_schedule_size) {
-          target_schedule_size = target_schedule_size - _gstate.schedule_size_step;
-        }
-        _gstate.last_target_schedule_size_update = block_time;
-        _gstate.target_producer_schedule_size = target_schedule_size;
-      }
+      _gstate.target_producer_schedule_size = voting_math::next_schedule_size( _gstate.target_producer_schedule_size, target_amount,
+                                                                               _gstate4.schedule_size_strategy, _gstate.schedule_size_step,
+                                                                               _gstate4.schedule_size_band, _gstate4.schedule_size_gain );
+      _gstate.last_target_schedule_size_update = block_time;
+   }
+
+   void system_contract::update_elected_producers( block_timestamp block_time ) {
+      _gstate.last_producer_schedule_update = block_time;
+
+      std::vector< std::pair<eosio::producer_key,uint16_t> > top_producers;
+      int32_t target_schedule_size = _gstate.target_producer_schedule_size;
 
       top_producers.reserve(target_schedule_size);
 
-      for ( auto it = idx.cbegin(); it != idx.cend() && top_producers.size() < target_schedule_size && 0 < it->total_votes && it->active(); ++it ) {
-         del_bandwidth_table del_tbl( _self, it->owner.value );
-         auto itr = del_tbl.find( it->owner.value );
+      /// the supply is read once per election, and only if producers need a minimum self stake
+      const int64_t token_supply = min_producer_activated_share > 0
+                                   ? eosio::token::get_supply(token_account, core_symbol().code() ).amount : 0;
+
+      auto has_enough_self_stake = [&]( const name owner, int64_t supply ) {
+         if( min_producer_activated_share <= 0 )
+            return true;
+         del_bandwidth_table del_tbl( _self, owner.value );
+         auto itr = del_tbl.find( owner.value );
          asset total_staked(0, core_symbol());
          if (itr != del_tbl.end()) {
             total_staked = itr->net_weight + itr->cpu_weight + itr->vote_weight;
          }
-         if (total_staked.amount >= min_producer_activated_share * token_supply.amount) {
-            top_producers.emplace_back( std::pair<eosio::producer_key,uint16_t>({{it->owner, it->producer_key}, it->location}) );
+         return total_staked.amount >= min_producer_activated_share * supply;
+      };
+
+      double cutoff_votes = 0;
+
+      /// the total_votes of a cache which was not just rebuilt may lag behind the producers table, the order does not
+      auto current_votes = [&]( const elected_candidate& c, bool fresh ) {
+         return fresh ? c.total_votes : producer_votes( _producers.get( c.owner.value, "producer not found" ) );
+      };
+
+      /// returns false if a producer outside of the cache may be ranked higher than the selected ones
+      auto select_from_cache = [&]( const election_cache& cache, bool fresh ) {
+         top_producers.clear();
+         cutoff_votes = 0;
+         const elected_candidate* lowest = nullptr; /// lowest ranked candidate visited
+         const elected_candidate* cutoff = nullptr; /// lowest ranked candidate selected
+         for( const auto& c : cache.candidates ) {
+            if( top_producers.size() >= target_schedule_size )
+               break;
+            lowest = &c;
+            if( has_enough_self_stake( c.owner, token_supply ) ) {
+               top_producers.emplace_back( std::pair<eosio::producer_key,uint16_t>({{c.owner, c.producer_key}, c.location}) );
+               cutoff = &c;
+            }
+         }
+         if( cutoff ) {
+            cutoff_votes = current_votes( *cutoff, fresh );
+         }
+         if( fresh ) {
+            return true;
          }
+         /// the visited candidates are ordered, they all rank above the excluded producers if the lowest one does
+         if( lowest && current_votes( *lowest, false ) <= cache.max_excluded_votes ) {
+            return false;
+         }
+         return top_producers.size() >= target_schedule_size || cache.max_excluded_votes <= 0;
+      };
+
+      auto cache = get_election_cache();
+      if( !cache || cache->capacity < target_schedule_size || !select_from_cache( *cache, false ) ) {
+         rebuild_election_cache();
+         select_from_cache( *_ecache, true );
       }
 
+      election_preview preview;
+      preview.producers.reserve( top_producers.size() );
+      for( const auto& item : top_producers )
+         preview.producers.push_back( item.first.producer_name );
+      preview.target_schedule_size = static_cast<uint16_t>( target_schedule_size );
+      preview.cutoff_votes         = cutoff_votes;
+      preview.vote_epoch           = _gstate4.vote_epoch;
+      publish_election_preview( std::move(preview), block_time );
+
       if (top_producers.empty()) {
          return;
       }
-      /// sort by producer name
-      std::sort( top_producers.begin(), top_producers.end() );
+      if( _gstate4.schedule_order == static_cast<uint8_t>(schedule_order_type::by_location) ) {
+         /// sort by location, producers of the same zone by name
+         std::sort( top_producers.begin(), top_producers.end(), []( const auto& a, const auto& b ) {
+            return std::tie( a.second, a.first.producer_name ) < std::tie( b.second, b.first.producer_name );
+         });
+      } else {
+         /// sort by producer name
+         std::sort( top_producers.begin(), top_producers.end() );
+      }
 
       std::vector<eosio::producer_key> producers;
 
@@ -148,10 +331,21 @@ namespace eosiosystem {
       }
    }
 
-   double stake2vote( int64_t staked ) {
-      /// TODO subtract 2080 brings the large numbers closer to this decade
-      double weight = int64_t( (now() - (block_timestamp::block_timestamp_epoch / 1000)) / (seconds_per_day * 7) )  / double( 52 );
-      return double(staked) * std::pow( 2, weight );
+   void system_contract::publish_election_preview( election_preview&& preview, block_timestamp block_time ) {
+      election_preview_singleton published( _self, _self.value );
+      if( published.exists() && published.get().same_election( preview ) ) {
+         return;
+      }
+      preview.last_change = block_time;
+      published.set( preview, _self );
+   }
+
+   int64_t seconds_since_block_epoch() {
+      return now() - (block_timestamp::block_timestamp_epoch / 1000);
+   }
+
+   double stake2vote( int64_t staked, uint16_t epoch ) {
+      return voting_math::stake2vote( staked, seconds_since_block_epoch(), epoch );
    }
 
    double system_contract::update_total_votepay_share( time_point ct,
@@ -182,27 +376,127 @@ namespace eosiosystem {
       return _gstate2.total_producer_votepay_share;
    }
 
-   double system_contract::update_producer_votepay_share( const producers_table2::const_iterator& prod_itr,
-                                                          time_point ct,
-                                                          double shares_rate,
-                                                          bool reset_to_zero )
-   {
-      double delta_votepay_share = 0.0;
-      if( shares_rate > 0.0 && ct > prod_itr->last_votepay_share_update ) {
-         delta_votepay_share = shares_rate * double( (ct - prod_itr->last_votepay_share_update).count() / 1E6 ); // cannot be negative
+   /// the offset of `producer` in the units of its producer_scale
+   double system_contract::votepay_offset( const name producer )const {
+      votepay_offset_table offsets( _self, _self.value );
+      auto itr = offsets.find( producer.value );
+      return itr != offsets.end() ? itr->offset : 0.0;
+   }
+
+   /// a zero offset is stored as no row
+   void system_contract::set_votepay_offset( const name producer, double offset ) {
+      votepay_offset_table offsets( _self, _self.value );
+      auto itr = offsets.find( producer.value );
+      if( itr == offsets.end() ) {
+         if( offset != 0.0 ) {
+            offsets.emplace( _self, [&]( auto& o ) {
+               o.owner  = producer;
+               o.offset = offset;
+            });
+         }
+      } else if( offset == 0.0 ) {
+         offsets.erase( itr );
+      } else {
+         offsets.modify( itr, same_payer, [&]( auto& o ) {
+            o.offset = offset;
+         });
       }
+   }
 
-      double new_votepay_share = prod_itr->votepay_share + delta_votepay_share;
-      _producers2.modify( prod_itr, same_payer, [&](auto& p) {
-         if( reset_to_zero )
-            p.votepay_share = 0.0;
-         else
-            p.votepay_share = new_votepay_share;
+   /**
+    *  Votepay share of a producer inside its 3 day window at `ct`: the settled share of producers2 plus the share
+    *  accrued at the current total_votes since then, corrected by the offset the vote changes left in votepayoff.
+    *  The rows hold the share in the units of producer_scale, the result is in the current vote epoch.
+    */
+   double system_contract::producer_votepay_share( const producer_info& prod, const producer_info2& prod2, time_point ct )const {
+      double share = prod2.votepay_share - votepay_offset( prod.owner );
+      if( prod.total_votes > 0.0 && ct > prod2.last_votepay_share_update ) {
+         share += prod.total_votes * double( (ct - prod2.last_votepay_share_update).count() / 1E6 );
+      }
+      return std::max( share, 0.0 ) * producer_scale( prod );
+   }
 
+   /**
+    *  Resets the votepay share of the producer at `ct` and returns it in the current vote epoch, accrued up to `ct`
+    *  if `accrue`.
+    *  The caller must reset the votepay offset of the producer in the same step.
+    */
+   double system_contract::settle_producer_votepay_share( const producer_info& prod, const producers_table2::const_iterator& prod2,
+                                                          time_point ct, bool accrue )
+   {
+      const double share = accrue ? producer_votepay_share( prod, *prod2, ct ) : prod2->votepay_share * producer_scale( prod );
+      _producers2.modify( prod2, same_payer, [&]( auto& p ) {
+         p.votepay_share             = 0.0;
          p.last_votepay_share_update = ct;
-      } );
+      });
+      return share;
+   }
+
+   /**
+    *  Applies the vote weight changes of a batch of producers: every producer row and its election cache entry
+    *  are updated exactly once, the global votepay totals once for the whole batch.
+    *  Every path changing producer votes goes through here.
+    *
+    *  Inside the 3 day window after a claim the votepay share keeps accruing through the votepay offset of the
+    *  producer, so producers2 is only written when the window closes and on claims.
+    *
+    *  @pre producers of the new vote set must be registered, and active if `voting`
+    */
+   void system_contract::apply_producer_deltas( const producer_delta_map& deltas, bool voting ) {
+      const auto ct = current_time_point();
+      double delta_change_rate         = 0.0;
+      double total_inactive_vpay_share = 0.0;
+      for( const auto& pd : deltas ) {
+         const double delta  = pd.second.first;
+         const bool   is_new = pd.second.second;
+         auto pitr = _producers.find( pd.first.value );
+         if( pitr == _producers.end() ) {
+            check( !is_new, "producer is not registered" ); //data corruption
+            continue;
+         }
+         check( !voting || pitr->active() || !is_new, "producer is not currently registered" );
+
+         /// the row may hold the votes of the previous epoch while the producer sweep runs, the deltas are current
+         const double scale            = producer_scale( *pitr );
+         const double init_total_votes = pitr->total_votes;
+         const double new_total_votes  = std::max( init_total_votes + delta / scale, 0.0 ); // floating point arithmetics can give small negative numbers
+
+         bool   accruing     = false;
+         bool   reset_offset = false;
+         double elapsed      = 0.0;
+         auto prod2 = _producers2.find( pd.first.value );
+         if( prod2 != _producers2.end() ) {
+            const auto last_claim_plus_3days = pitr->last_claim_time + microseconds(3 * useconds_per_day);
+            bool crossed_threshold       = (last_claim_plus_3days <= ct);
+            bool updated_after_threshold = (last_claim_plus_3days <= prod2->last_votepay_share_update);
+            // Note: updated_after_threshold implies cross_threshold
 
-      return new_votepay_share;
+            if( !crossed_threshold ) {
+               accruing = true;
+               elapsed  = std::max( double( (ct - prod2->last_votepay_share_update).count() / 1E6 ), 0.0 );
+               delta_change_rate += delta;
+            } else if( !updated_after_threshold ) {
+               // only reset votepay_share once after threshold
+               total_inactive_vpay_share += settle_producer_votepay_share( *pitr, prod2, ct, true );
+               reset_offset = true;
+               delta_change_rate -= init_total_votes * scale;
+            }
+         }
+
+         _producers.modify( pitr, same_payer, [&]( auto& p ) {
+            p.total_votes = new_total_votes;
+         });
+         if( accruing ) {
+            set_votepay_offset( pd.first, votepay_offset( pd.first ) + (new_total_votes - init_total_votes) * elapsed );
+         } else if( reset_offset ) {
+            set_votepay_offset( pd.first, 0.0 );
+         }
+         _gstate.total_producer_vote_weight += delta;
+         place_producer( *pitr, scale );
+         update_election_cache( *pitr );
+      }
+
+      update_total_votepay_share( ct, -total_inactive_vpay_share, delta_change_rate );
    }
 
    /**
@@ -257,19 +551,22 @@ namespace eosiosystem {
          }
       }
 
-      auto new_vote_weight = stake2vote( voter->staked );
+      rescale_voter( *voter );
+      auto new_vote_weight = stake2vote( voter->staked, _gstate4.vote_epoch );
       if( voter->is_proxy ) {
          new_vote_weight += voter->proxied_vote_weight;
       }
 
-      boost::container::flat_map<name, pair<double, bool /*new*/> > producer_deltas;
+      producer_delta_map producer_deltas;
       if ( voter->last_vote_weight > 0 ) {
          if( voter->proxy ) {
             auto old_proxy = _voters.find( voter->proxy.value );
             check( old_proxy != _voters.end(), "old proxy not found" ); //data corruption
             _voters.modify( old_proxy, same_payer, [&]( auto& vp ) {
+                  vp.rescale( _gstate4.vote_epoch );
                   vp.proxied_vote_weight -= voter->last_vote_weight;
                });
+            track_proxy_rebuild( voter->proxy, voter_name, -voter->last_vote_weight );
             propagate_weight_change( *old_proxy );
          } else {
             for( const auto& p : voter->producers ) {
@@ -286,8 +583,10 @@ namespace eosiosystem {
          check( !voting || new_proxy->is_proxy, "proxy not found" );
          if ( new_vote_weight >= 0 ) {
             _voters.modify( new_proxy, same_payer, [&]( auto& vp ) {
+                  vp.rescale( _gstate4.vote_epoch );
                   vp.proxied_vote_weight += new_vote_weight;
                });
+            track_proxy_rebuild( proxy, voter_name, new_vote_weight );
             propagate_weight_change( *new_proxy );
          }
       } else {
@@ -300,56 +599,18 @@ namespace eosiosystem {
          }
       }
 
-      const auto ct = current_time_point();
-      double delta_change_rate         = 0.0;
-      double total_inactive_vpay_share = 0.0;
-      for( const auto& pd : producer_deltas ) {
-         auto pitr = _producers.find( pd.first.value );
-         if( pitr != _producers.end() ) {
-            check( !voting || pitr->active() || !pd.second.second /* not from new set */, "producer is not currently registered" );
-            double init_total_votes = pitr->total_votes;
-            _producers.modify( pitr, same_payer, [&]( auto& p ) {
-               p.total_votes += pd.second.first;
-               if ( p.total_votes < 0 ) { // floating point arithmetics can give small negative numbers
-                  p.total_votes = 0;
-               }
-               _gstate.total_producer_vote_weight += pd.second.first;
-               //check( p.total_votes >= 0, "something bad happened" );
-            });
-            auto prod2 = _producers2.find( pd.first.value );
-            if( prod2 != _producers2.end() ) {
-               const auto last_claim_plus_3days = pitr->last_claim_time + microseconds(3 * useconds_per_day);
-               bool crossed_threshold       = (last_claim_plus_3days <= ct);
-               bool updated_after_threshold = (last_claim_plus_3days <= prod2->last_votepay_share_update);
-               // Note: updated_after_threshold implies cross_threshold
-
-               double new_votepay_share = update_producer_votepay_share( prod2,
-                                             ct,
-                                             updated_after_threshold ? 0.0 : init_total_votes,
-                                             crossed_threshold && !updated_after_threshold // only reset votepay_share once after threshold
-                                          );
-
-               if( !crossed_threshold ) {
-                  delta_change_rate += pd.second.first;
-               } else if( !updated_after_threshold ) {
-                  total_inactive_vpay_share += new_votepay_share;
-                  delta_change_rate -= init_total_votes;
-               }
-            }
-         } else {
-            check( !pd.second.second /* not from new set */, "producer is not registered" ); //data corruption
-         }
-      }
-
-      update_total_votepay_share( ct, -total_inactive_vpay_share, delta_change_rate );
+      apply_producer_deltas( producer_deltas, voting );
 
       bool is_active_before = voter->is_active();
+      const name old_proxy  = voter->proxy;
 
       _voters.modify( voter, same_payer, [&]( auto& av ) {
          av.last_vote_weight = new_vote_weight;
          av.producers = producers;
          av.proxy     = proxy;
       });
+      update_proxy_follower( *voter, old_proxy );
+      set_vote_pending( *voter, false );
 
       // only voting can change is_active state
       if (voting) {
@@ -362,6 +623,8 @@ namespace eosiosystem {
         if (is_active_before && !is_active_after) {
           _gstate.active_stake -= voter->staked;
         }
+
+        update_vote_activity( *voter );
       }
    }
 
@@ -393,63 +656,410 @@ namespace eosiosystem {
       }
    }
 
-   void system_contract::propagate_weight_change( const voter_info& voter ) {
+   /**
+    *  Passes the change of the weight of `voter` on to its proxy or producers. Changes up to the propagation
+    *  epsilon are held back: last_vote_weight keeps the weight that was passed on and the voter is listed in
+    *  votepending until the change grows or the pending votes are flushed with `force`.
+    */
+   void system_contract::propagate_weight_change( const voter_info& voter, bool force ) {
       check( !voter.proxy || !voter.is_proxy, "account registered as a proxy is not allowed to use a proxy" );
-      double new_weight = stake2vote( voter.staked );
+      rescale_voter( voter );
+      double new_weight = stake2vote( voter.staked, _gstate4.vote_epoch );
       if ( voter.is_proxy ) {
          new_weight += voter.proxied_vote_weight;
       }
 
-      /// don't propagate small changes (1 ~= epsilon)
-      if ( fabs( new_weight - voter.last_vote_weight ) > 1 )  {
-         if ( voter.proxy ) {
-            auto& proxy = _voters.get( voter.proxy.value, "proxy not found" ); //data corruption
-            _voters.modify( proxy, same_payer, [&]( auto& p ) {
-                  p.proxied_vote_weight += new_weight - voter.last_vote_weight;
-               }
-            );
-            propagate_weight_change( proxy );
-         } else {
-            auto delta = new_weight - voter.last_vote_weight;
-            const auto ct = current_time_point();
-            double delta_change_rate         = 0;
-            double total_inactive_vpay_share = 0;
-            for ( auto acnt : voter.producers ) {
-               auto& prod = _producers.get( acnt.value, "producer not found" ); //data corruption
-               const double init_total_votes = prod.total_votes;
-               _producers.modify( prod, same_payer, [&]( auto& p ) {
-                  p.total_votes += delta;
-                  _gstate.total_producer_vote_weight += delta;
-               });
-               auto prod2 = _producers2.find( acnt.value );
-               if ( prod2 != _producers2.end() ) {
-                  const auto last_claim_plus_3days = prod.last_claim_time + microseconds(3 * useconds_per_day);
-                  bool crossed_threshold       = (last_claim_plus_3days <= ct);
-                  bool updated_after_threshold = (last_claim_plus_3days <= prod2->last_votepay_share_update);
-                  // Note: updated_after_threshold implies cross_threshold
-
-                  double new_votepay_share = update_producer_votepay_share( prod2,
-                                                ct,
-                                                updated_after_threshold ? 0.0 : init_total_votes,
-                                                crossed_threshold && !updated_after_threshold // only reset votepay_share once after threshold
-                                             );
-
-                  if( !crossed_threshold ) {
-                     delta_change_rate += delta;
-                  } else if( !updated_after_threshold ) {
-                     total_inactive_vpay_share += new_votepay_share;
-                     delta_change_rate -= init_total_votes;
-                  }
-               }
-            }
+      const double delta = new_weight - voter.last_vote_weight;
+      if ( delta == 0 || ( !force && fabs( delta ) <= _gstate4.vote_propagation_epsilon ) ) {
+         set_vote_pending( voter, delta != 0 );
+         return;
+      }
 
-            update_total_votepay_share( ct, -total_inactive_vpay_share, delta_change_rate );
+      if ( voter.proxy ) {
+         auto& proxy = _voters.get( voter.proxy.value, "proxy not found" ); //data corruption
+         _voters.modify( proxy, same_payer, [&]( auto& p ) {
+               p.rescale( _gstate4.vote_epoch );
+               p.proxied_vote_weight += delta;
+            }
+         );
+         track_proxy_rebuild( voter.proxy, voter.owner, delta );
+         propagate_weight_change( proxy );
+      } else {
+         producer_delta_map producer_deltas;
+         for ( auto acnt : voter.producers ) {
+            producer_deltas[acnt] = { delta, false };
          }
+         apply_producer_deltas( producer_deltas, false );
       }
+      set_vote_pending( voter, false );
       _voters.modify( voter, same_payer, [&]( auto& v ) {
             v.last_vote_weight = new_weight;
          }
       );
    }
 
+   void system_contract::set_vote_pending( const voter_info& voter, bool pending ) {
+      if( has_field( voter.flags1, voter_info::flags1_fields::vote_pending ) == pending ) {
+         return;
+      }
+      pending_vote_table pending_votes( _self, _self.value );
+      if( pending ) {
+         pending_votes.emplace( _self, [&]( auto& p ) {
+            p.owner = voter.owner;
+         });
+      } else {
+         pending_votes.erase( pending_votes.get( voter.owner.value, "pending vote not found" ) ); //data corruption
+      }
+      _voters.modify( voter, same_payer, [&]( auto& v ) {
+         v.flags1 = set_field( v.flags1, voter_info::flags1_fields::vote_pending, pending );
+      });
+   }
+
+   /**
+    *  Propagates at most `max_rows` held back votes regardless of the epsilon. A flushed follower may leave its
+    *  proxy pending in turn, which a later flush picks up.
+    */
+   void system_contract::flush_pending_votes( uint32_t max_rows ) {
+      pending_vote_table pending_votes( _self, _self.value );
+      for( uint32_t rows = 0; rows < max_rows; ++rows ) {
+         auto itr = pending_votes.begin();
+         if( itr == pending_votes.end() ) {
+            break;
+         }
+         propagate_weight_change( _voters.get( itr->owner.value, "voter not found" ), true ); //data corruption
+      }
+   }
+
+   void system_contract::rescale_voter( const voter_info& voter ) {
+      if( voter.vote_epoch < _gstate4.vote_epoch ) {
+         _voters.modify( voter, same_payer, [&]( auto& v ) {
+            v.rescale( _gstate4.vote_epoch );
+         });
+      }
+   }
+
+   /**
+    *  Moves the election cache, the vote and votepay totals and the propagation epsilon to `epoch` at once and starts
+    *  the sweeps over the producers and the voters. Voters keep their epoch and are converted when they are next
+    *  touched or by the voter sweep, producers the producer sweep did not reach yet keep the previous epoch.
+    *
+    *  @pre no producer sweep is running
+    */
+   void system_contract::advance_vote_epoch( uint16_t epoch ) {
+      const double scale = voting_math::epoch_scale( _gstate4.vote_epoch, epoch );
+
+      update_total_votepay_share( current_time_point() ); // accrue at the old rate first
+      _gstate2.total_producer_votepay_share *= scale;
+      _gstate3.total_vpay_share_change_rate *= scale;
+      _gstate.total_producer_vote_weight    *= scale;
+      _gstate4.vote_propagation_epsilon     *= scale; // holds back the same weight as before
+
+      if( auto cache = get_election_cache() ) {
+         for( auto& c : cache->candidates ) {
+            c.total_votes *= scale;
+         }
+         cache->max_excluded_votes *= scale;
+         _ecache_dirty = true;
+      }
+
+      _gstate4.producer_sweep_phase  = static_cast<uint8_t>( producer_sweep_phase_type::ascending );
+      _gstate4.producer_sweep_cursor = name();
+      _gstate4.producer_sweep_key    = 0;
+      _gstate4.producer_sweep_scale  = scale;
+
+      _gstate4.vote_epoch         = epoch;
+      _gstate4.vote_sweep_cursor  = name();
+      _gstate4.vote_sweep_pending = true;
+   }
+
+   /**
+    *  Whether a producer with the "prototalvote" key `key` holds the weights of the current vote epoch. The producer
+    *  sweep converts the rows closest to the zero key first, so the rows it did not reach yet are the ones beyond its
+    *  cursor. This holds for the stored key of a row as well as for the key of its weights in the current epoch.
+    */
+   bool system_contract::producer_rescaled( double key, const name owner )const {
+      const bool started = _gstate4.producer_sweep_cursor != name();
+      const double cursor_key = _gstate4.producer_sweep_key;
+      switch( static_cast<producer_sweep_phase_type>( _gstate4.producer_sweep_phase ) ) {
+         case producer_sweep_phase_type::ascending:
+            return 0 <= key && started
+                   && (key < cursor_key || (key == cursor_key && owner <= _gstate4.producer_sweep_cursor));
+         case producer_sweep_phase_type::descending:
+            return 0 <= key || (started
+                   && (cursor_key < key || (key == cursor_key && _gstate4.producer_sweep_cursor <= owner)));
+         default:
+            return true;
+      }
+   }
+
+   /// factor converting the votes and the votepay share stored for `prod` to the current vote epoch
+   double system_contract::producer_scale( const producer_info& prod )const {
+      return producer_rescaled( prod.by_votes(), prod.owner ) ? 1.0 : _gstate4.producer_sweep_scale;
+   }
+
+   double system_contract::producer_votes( const producer_info& prod )const {
+      return prod.total_votes * producer_scale( prod );
+   }
+
+   /// scaling the votes along with the votepay share keeps the pending accrual exact
+   void system_contract::rescale_producer( const producer_info& prod, double scale ) {
+      _producers.modify( prod, same_payer, [&]( auto& p ) {
+         p.total_votes *= scale;
+      });
+      votepay_offset_table offsets( _self, _self.value );
+      auto offset = offsets.find( prod.owner.value );
+      if( offset != offsets.end() ) {
+         offsets.modify( offset, same_payer, [&]( auto& o ) {
+            o.offset *= scale;
+         });
+      }
+      auto prod2 = _producers2.find( prod.owner.value );
+      if( prod2 != _producers2.end() ) {
+         _producers2.modify( prod2, same_payer, [&]( auto& p ) {
+            p.votepay_share *= scale;
+         });
+      }
+   }
+
+   /**
+    *  Must be called after every change of total_votes or is_active of a producer, with the producer_scale of the
+    *  row before the change. A row that crossed the cursor of the producer sweep is converted to the epoch of the
+    *  rows on its new side.
+    */
+   void system_contract::place_producer( const producer_info& prod, double scale ) {
+      const double target = producer_rescaled( prod.by_votes() * scale, prod.owner ) ? 1.0 : _gstate4.producer_sweep_scale;
+      if( target != scale ) {
+         rescale_producer( prod, scale / target );
+      }
+   }
+
+   /**
+    *  Converts at most `max_rows` producers of the running producer sweep to the current vote epoch, continuing
+    *  after the cursor in the "prototalvote" index.
+    *
+    *  @return the number of producers converted
+    */
+   uint32_t system_contract::rescale_producers( uint32_t max_rows ) {
+      auto idx = _producers.get_index<"prototalvote"_n>();
+      uint32_t rows = 0;
+      while( _gstate4.producer_sweep_phase != static_cast<uint8_t>( producer_sweep_phase_type::none ) && rows < max_rows ) {
+         const bool ascending = _gstate4.producer_sweep_phase == static_cast<uint8_t>( producer_sweep_phase_type::ascending );
+         const bool started   = _gstate4.producer_sweep_cursor != name();
+
+         /// first row after the cursor if ascending, first row not before it otherwise
+         auto itr = idx.lower_bound( started ? _gstate4.producer_sweep_key : 0.0 );
+         while( started && itr != idx.end() && itr->by_votes() == _gstate4.producer_sweep_key
+                && (itr->owner < _gstate4.producer_sweep_cursor || (ascending && itr->owner == _gstate4.producer_sweep_cursor)) ) {
+            ++itr;
+         }
+
+         if( ascending ? itr == idx.end() : itr == idx.begin() ) {
+            _gstate4.producer_sweep_phase  = static_cast<uint8_t>( ascending ? producer_sweep_phase_type::descending
+                                                                             : producer_sweep_phase_type::none );
+            _gstate4.producer_sweep_cursor = name();
+            _gstate4.producer_sweep_key    = 0;
+            continue;
+         }
+         if( !ascending ) {
+            --itr;
+         }
+
+         const auto& prod = *itr;
+         rescale_producer( prod, _gstate4.producer_sweep_scale );
+         _gstate4.producer_sweep_cursor = prod.owner;
+         _gstate4.producer_sweep_key    = prod.by_votes();
+         ++rows;
+      }
+      if( _gstate4.producer_sweep_phase == static_cast<uint8_t>( producer_sweep_phase_type::none ) ) {
+         _gstate4.producer_sweep_scale = 1;
+      }
+      return rows;
+   }
+
+   /**
+    *  Advances the vote epoch if a new 52 week period started and the previous producer sweep is complete, then
+    *  converts at most `max_rows` rows of the sweeps, producers first.
+    *
+    *  @return false if there was nothing to do
+    */
+   bool system_contract::rescale_votes( uint32_t max_rows ) {
+      bool changed = false;
+      const uint16_t epoch = voting_math::vote_epoch( seconds_since_block_epoch() );
+      if( _gstate4.vote_epoch < epoch
+          && _gstate4.producer_sweep_phase == static_cast<uint8_t>( producer_sweep_phase_type::none ) ) {
+         advance_vote_epoch( epoch );
+         changed = true;
+      }
+      if( _gstate4.producer_sweep_phase != static_cast<uint8_t>( producer_sweep_phase_type::none ) && max_rows > 0 ) {
+         max_rows -= rescale_producers( max_rows );
+         changed = true;
+      }
+      if( !_gstate4.vote_sweep_pending || max_rows == 0 ) {
+         return changed;
+      }
+
+      auto itr = _voters.upper_bound( _gstate4.vote_sweep_cursor.value );
+      for( uint32_t rows = 0; rows < max_rows && itr != _voters.end(); ++rows, ++itr ) {
+         rescale_voter( *itr );
+         _gstate4.vote_sweep_cursor = itr->owner;
+      }
+      if( itr == _voters.end() ) {
+         _gstate4.vote_sweep_cursor  = name();
+         _gstate4.vote_sweep_pending = false;
+      }
+      return true;
+   }
+
+   void system_contract::rescalevote( uint32_t max_rows ) {
+      check( 0 < max_rows, "max_rows must be positive" );
+      check( rescale_votes( max_rows ), "action has no effect" );
+   }
+
+   /**
+    *  Records the time of a vote of `voter`, the row is removed once the voter stops voting. Rows are billed to
+    *  the contract, like the index rows of proxy followers.
+    */
+   void system_contract::update_vote_activity( const voter_info& voter ) {
+      vote_activity_table activity( _self, _self.value );
+      auto itr = activity.find( voter.owner.value );
+      if( !voter.is_active() ) {
+         if( itr != activity.end() )
+            activity.erase( itr );
+      } else if( itr == activity.end() ) {
+         activity.emplace( _self, [&]( auto& a ) {
+            a.owner          = voter.owner;
+            a.last_vote_time = current_time_point_sec();
+         });
+      } else {
+         activity.modify( itr, same_payer, [&]( auto& a ) {
+            a.last_vote_time = current_time_point_sec();
+         });
+      }
+   }
+
+   /**
+    *  Adds a vote activity row for the accounts voting without one among at most `max_rows` voters after the cursor.
+    *  Their last vote is unknown, so it counts as cast when the sweep reaches them and expires a full period later.
+    *
+    *  @return false if every account voting already had a row
+    */
+   bool system_contract::index_vote_activity( uint32_t max_rows ) {
+      if( _gstate4.vote_activity_complete ) {
+         return false;
+      }
+
+      vote_activity_table activity( _self, _self.value );
+      auto itr = _voters.upper_bound( _gstate4.vote_activity_cursor.value );
+      for( uint32_t rows = 0; rows < max_rows && itr != _voters.end(); ++rows, ++itr ) {
+         if( itr->is_active() && activity.find( itr->owner.value ) == activity.end() ) {
+            activity.emplace( _self, [&]( auto& a ) {
+               a.owner          = itr->owner;
+               a.last_vote_time = current_time_point_sec();
+            });
+         }
+         _gstate4.vote_activity_cursor = itr->owner;
+      }
+      if( itr == _voters.end() ) {
+         _gstate4.vote_activity_cursor   = name();
+         _gstate4.vote_activity_complete = true;
+      }
+      return true;
+   }
+
+   void system_contract::indexvoteact( uint32_t max_rows ) {
+      check( 0 < max_rows, "max_rows must be positive" );
+      check( index_vote_activity( max_rows ), "action has no effect" );
+   }
+
+   /**
+    *  Withdraws the producer or proxy votes of `voter` like an empty voteproducer would, the producer changes are
+    *  added to `deltas` for the caller to apply once for a batch of voters.
+    */
+   void system_contract::withdraw_votes( const voter_info& voter, producer_delta_map& deltas ) {
+      rescale_voter( voter );
+      if( voter.last_vote_weight > 0 ) {
+         if( voter.proxy ) {
+            const auto& proxy = _voters.get( voter.proxy.value, "old proxy not found" ); //data corruption
+            _voters.modify( proxy, same_payer, [&]( auto& vp ) {
+               vp.rescale( _gstate4.vote_epoch );
+               vp.proxied_vote_weight -= voter.last_vote_weight;
+            });
+            track_proxy_rebuild( voter.proxy, voter.owner, -voter.last_vote_weight );
+            propagate_weight_change( proxy );
+         } else {
+            for( const auto& p : voter.producers ) {
+               deltas[p].first -= voter.last_vote_weight;
+            }
+         }
+      }
+
+      if( voter.is_active() ) {
+         _gstate.active_stake -= voter.staked;
+      }
+      if( voter.proxy ) {
+         remove_proxy_follower( voter.proxy, voter.owner );
+      }
+
+      double new_vote_weight = stake2vote( voter.staked, _gstate4.vote_epoch );
+      if( voter.is_proxy ) {
+         new_vote_weight += voter.proxied_vote_weight;
+      }
+      _voters.modify( voter, same_payer, [&]( auto& v ) {
+         v.last_vote_weight = new_vote_weight;
+         v.producers.clear();
+         v.proxy = name();
+      });
+      set_vote_pending( voter, false );
+   }
+
+   /**
+    *  Withdraws the votes of at most `max_rows` voters whose last vote is older than the vote expiry time,
+    *  the producer deltas of the whole batch are applied at once.
+    *
+    *  @return false if no vote expired
+    */
+   bool system_contract::expire_stale_votes( uint32_t max_rows ) {
+      if( _gstate4.vote_expiry_time == 0 ) {
+         return false;
+      }
+      const uint32_t now_sec = current_time_point_sec().sec_since_epoch();
+      if( now_sec <= _gstate4.vote_expiry_time ) {
+         return false;
+      }
+      const uint64_t expired_before = now_sec - _gstate4.vote_expiry_time;
+
+      vote_activity_table activity( _self, _self.value );
+      auto idx = activity.get_index<"bylastvote"_n>();
+      producer_delta_map deltas;
+      uint32_t rows = 0;
+      for( auto itr = idx.begin(); itr != idx.end() && rows < max_rows && itr->by_last_vote() < expired_before; ++rows ) {
+         withdraw_votes( _voters.get( itr->owner.value, "voter not found" ), deltas ); //data corruption
+         itr = idx.erase( itr );
+      }
+      if( rows == 0 ) {
+         return false;
+      }
+
+      apply_producer_deltas( deltas, false );
+      return true;
+   }
+
+   void system_contract::setvoteexp( uint32_t expiry_time ) {
+      require_auth( _self );
+      _gstate4.vote_expiry_time = expiry_time;
+   }
+
+   void system_contract::setvoteprop( double epsilon, uint16_t flush_batch_size ) {
+      require_auth( _self );
+      check( 0 <= epsilon, "epsilon must not be negative" );
+      _gstate4.vote_propagation_epsilon = epsilon;
+      _gstate4.vote_flush_batch_size    = flush_batch_size;
+   }
+
+   void system_contract::expirevotes( uint32_t max_rows ) {
+      check( 0 < max_rows, "max_rows must be positive" );
+      check( _gstate4.vote_expiry_time > 0, "vote expiry is disabled" );
+      check( expire_stale_votes( max_rows ), "action has no effect" );
+   }
+
 } /// namespace eosiosystem
@@ -0,0 +1,120 @@
+/**
+ *  Microbenchmarks of the contract kernels built for the host.
+ *
+ *  kernel_bench [iterations] [filter]
+ *
+ *  Runs every kernel whose name contains `filter` `iterations` times (default 10000000)
+ *  over pregenerated inputs in realistic ranges and prints ns/op and throughput.
+ */
+#include <kernels.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+using namespace eosiosystem;
+
+namespace {
+
+   constexpr size_t input_count = 4096; // power of two, fits in L1 together with the kernel tables
+
+   struct exchange_input {
+      int64_t supply;
+      int64_t balance;
+      int64_t in;
+   };
+
+   struct emission_input {
+      int64_t active_stake;
+      int64_t supply;
+      int64_t usecs;
+   };
+
+   struct vote_input {
+      int64_t staked;
+      int64_t seconds;
+   };
+
+   std::array<exchange_input, input_count> exchange_inputs;
+   std::array<emission_input, input_count> emission_inputs;
+   std::array<vote_input, input_count>     vote_inputs;
+
+   void generate_inputs() {
+      std::mt19937_64 rng( 0 );
+      auto uniform = [&]( int64_t lo, int64_t hi ) { return std::uniform_int_distribution<int64_t>( lo, hi )( rng ); };
+      for( size_t i = 0; i < input_count; ++i ) {
+         // RAMCORE supply and RAM / core token connectors of a running chain
+         exchange_inputs[i] = { 100'000'000'000'000ll, uniform( 1'000'000'000ll, 70'000'000'000ll ), uniform( 1, 100'000'000 ) };
+         const int64_t supply = uniform( 1'000'000'000'000ll, 10'000'000'000'000ll );
+         emission_inputs[i] = { uniform( 0, supply ), supply, uniform( 1, 30 * 24 * 3600 * 1'000'000ll ) };
+         vote_inputs[i] = { uniform( 1, 1'000'000'000'000ll ), uniform( 0, 30 * 52 * 7 * 24 * 3600ll ) };
+      }
+   }
+
+   double sink = 0; // results are accumulated so that the calls are not optimized away
+
+   template<typename Kernel>
+   void run( const char* name, const char* filter, size_t iterations, Kernel&& kernel ) {
+      if( filter && !std::strstr( name, filter ) )
+         return;
+
+      for( size_t i = 0; i < input_count; ++i ) { // warm up
+         sink += kernel( i );
+      }
+
+      const auto start = std::chrono::steady_clock::now();
+      for( size_t i = 0; i < iterations; ++i ) {
+         sink += kernel( i & (input_count - 1) );
+      }
+      const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+      const double ns_per_op = elapsed.count() / iterations;
+      std::printf( "%-24s %12.2f ns/op %12.2f Mops/s\n", name, ns_per_op, 1e3 / ns_per_op );
+   }
+
+}
+
+int main( int argc, char** argv ) {
+   const size_t iterations = argc > 1 ? std::strtoull( argv[1], nullptr, 10 ) : 10'000'000;
+   const char*  filter     = argc > 2 ? argv[2] : nullptr;
+   if( iterations == 0 ) {
+      std::fprintf( stderr, "usage: %s [iterations] [filter]\n", argv[0] );
+      return 1;
+   }
+
+   generate_inputs();
+
+   run( "convert_to_exchange", filter, iterations, []( size_t i ) {
+      const auto& in = exchange_inputs[i];
+      return double( native::convert_to_exchange( in.supply, in.balance, 0.5, in.in ) );
+   });
+   run( "convert_from_exchange", filter, iterations, []( size_t i ) {
+      const auto& in = exchange_inputs[i];
+      return double( native::convert_from_exchange( in.supply, in.balance, 0.5, in.in ) );
+   });
+   run( "get_continuous_rate", filter, iterations, []( size_t i ) {
+      const auto& in = emission_inputs[i];
+      return double( native::get_continuous_rate( in.active_stake, in.supply ) );
+   });
+   run( "get_emission", filter, iterations, []( size_t i ) {
+      const auto& in = emission_inputs[i];
+      return double( native::get_emission( native::get_continuous_rate( in.active_stake, in.supply ), in.supply, in.usecs ) );
+   });
+   run( "get_target_amount", filter, iterations, []( size_t i ) {
+      return double( native::get_target_amount( int32_t( i % 101 ) ) );
+   });
+   run( "next_schedule_size", filter, iterations, []( size_t i ) {
+      return double( native::next_schedule_size( 21 + int32_t( i % 82 ), native::get_target_amount( int32_t( i % 101 ) ),
+                                                 uint8_t( i % 3 ), 3, 6, 50 ) );
+   });
+   run( "stake2vote", filter, iterations, []( size_t i ) {
+      const auto& in = vote_inputs[i];
+      return native::stake2vote( in.staked, in.seconds );
+   });
+
+   std::printf( "checksum %g\n", sink );
+   return 0;
+}
@@ -0,0 +1,37 @@
+#include <kernels.hpp>
+
+#include <eosio.system/emission.hpp>
+#include <eosio.system/exchange_math.hpp>
+#include <eosio.system/voting_math.hpp>
+
+namespace eosiosystem { namespace native {
+
+   int64_t convert_to_exchange( int64_t supply, int64_t balance, double weight, int64_t in ) {
+      return exchange_math::convert_to_exchange( supply, balance, weight, in );
+   }
+
+   int64_t convert_from_exchange( int64_t supply, int64_t balance, double weight, int64_t in ) {
+      return exchange_math::convert_from_exchange( supply, balance, weight, in );
+   }
+
+   int64_t get_continuous_rate( int64_t active_stake, int64_t supply ) {
+      return emission::get_continuous_rate( active_stake, supply );
+   }
+
+   int64_t get_emission( int64_t rate, int64_t supply, int64_t usecs ) {
+      return emission::get_emission( rate, supply, usecs );
+   }
+
+   int32_t get_target_amount( int32_t activated_share ) {
+      return voting_math::get_target_amount( activated_share );
+   }
+
+   int32_t next_schedule_size( int32_t size, int32_t target, uint8_t strategy, int32_t step, int32_t band, int32_t gain_percent ) {
+      return voting_math::next_schedule_size( size, target, strategy, step, band, gain_percent );
+   }
+
+   double stake2vote( int64_t staked, int64_t seconds_since_epoch ) {
+      return voting_math::stake2vote( staked, seconds_since_epoch );
+   }
+
+} } /// namespace eosiosystem::native
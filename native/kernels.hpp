@@ -0,0 +1,28 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <cstdint>
+
+/**
+ *  Out of line entry points to the contract kernels, so that benchmarks and profilers
+ *  see one symbol per kernel instead of code inlined into the caller.
+ */
+namespace eosiosystem { namespace native {
+
+   // exchange_math.hpp
+   int64_t convert_to_exchange( int64_t supply, int64_t balance, double weight, int64_t in );
+   int64_t convert_from_exchange( int64_t supply, int64_t balance, double weight, int64_t in );
+
+   // emission.hpp
+   int64_t get_continuous_rate( int64_t active_stake, int64_t supply );
+   int64_t get_emission( int64_t rate, int64_t supply, int64_t usecs );
+
+   // voting_math.hpp
+   int32_t get_target_amount( int32_t activated_share );
+   int32_t next_schedule_size( int32_t size, int32_t target, uint8_t strategy, int32_t step, int32_t band, int32_t gain_percent );
+   double  stake2vote( int64_t staked, int64_t seconds_since_epoch );
+
+} } /// namespace eosiosystem::native
@@ -0,0 +1,189 @@
+/**
+ *  Differential fuzzing of the RAM market kernels against a high precision reference.
+ *
+ *  ram_market_fuzz [operations] [seed]
+ *
+ *  Drives random buyram / sellram sequences through the exchange_math kernels, the way exchange_state::convert
+ *  chains them, and recomputes every conversion exactly from the same market state with 50 decimal digits.
+ *  Reports the error of each conversion against the exact truncated result, the drift of the market balances
+ *  against a market evolving without truncation, buy and sell round trips returning more than was spent
+ *  (with and without the 0.5% buyram fee) and kernel throughput on the recorded conversions.
+ *
+ *  Exits with 1 if a round trip returns more than was spent including the fee.
+ */
+#include <kernels.hpp>
+
+#include <boost/multiprecision/cpp_bin_float.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace eosiosystem;
+using real = boost::multiprecision::cpp_bin_float_50;
+
+namespace {
+
+   const double weight = 0.5;
+
+   template<typename T>
+   struct market {
+      T supply;  // RAMCORE
+      T base;    // RAM bytes
+      T quote;   // core token
+   };
+
+   /// exact counterparts of the kernels in exchange_math.hpp
+   real to_exchange( const real& supply, const real& balance, const real& in ) {
+      return supply * ( boost::multiprecision::pow( 1 + in / (balance + in), real(weight) ) - 1 );
+   }
+
+   real from_exchange( const real& supply, const real& balance, const real& in ) {
+      return balance * ( boost::multiprecision::pow( 1 + in / (supply - in), real(1 / weight) ) - 1 );
+   }
+
+   struct conversion_stats {
+      std::map<int64_t, uint64_t> errors; // kernel result minus exact truncated result
+      uint64_t                    count = 0;
+      uint64_t                    favoring_user = 0;
+
+      void add( int64_t kernel, const real& exact ) {
+         const int64_t err = kernel - exact.convert_to<int64_t>();
+         ++errors[err];
+         ++count;
+         if( err > 0 )
+            ++favoring_user;
+      }
+
+      void print( const char* name )const {
+         std::printf( "%s: %llu conversions, %llu rounded in favor of the user\n", name,
+                      (unsigned long long)count, (unsigned long long)favoring_user );
+         for( const auto& e : errors ) {
+            std::printf( "   error %+lld: %llu\n", (long long)e.first, (unsigned long long)e.second );
+         }
+      }
+   };
+
+   struct kernel_input {
+      bool    to_exchange;
+      int64_t supply;
+      int64_t balance;
+      int64_t in;
+   };
+
+   std::vector<kernel_input> recorded; // replayed to measure throughput
+   const size_t max_recorded = 1 << 20;
+
+   void record( bool to_exchange, int64_t supply, int64_t balance, int64_t in ) {
+      if( recorded.size() < max_recorded )
+         recorded.push_back( { to_exchange, supply, balance, in } );
+   }
+
+   /// exchange_state::convert of core tokens to bytes and back, on the kernels
+   int64_t convert( market<int64_t>& m, int64_t in, bool buy, conversion_stats& stats ) {
+      auto& from = buy ? m.quote : m.base;
+      auto& to   = buy ? m.base  : m.quote;
+
+      record( true, m.supply, from, in );
+      const int64_t issued = native::convert_to_exchange( m.supply, from, weight, in );
+      stats.add( issued, to_exchange( m.supply, from, in ) );
+      m.supply += issued;
+      from     += in;
+
+      record( false, m.supply, to, issued );
+      const int64_t out = native::convert_from_exchange( m.supply, to, weight, issued );
+      stats.add( out, from_exchange( m.supply, to, issued ) );
+      m.supply -= issued;
+      to       -= out;
+
+      return out;
+   }
+
+   real convert( market<real>& m, const real& in, bool buy ) {
+      auto& from = buy ? m.quote : m.base;
+      auto& to   = buy ? m.base  : m.quote;
+      const real issued = to_exchange( m.supply, from, in );
+      m.supply += issued;
+      from     += in;
+      const real out = from_exchange( m.supply, to, issued );
+      m.supply -= issued;
+      to       -= out;
+      return out;
+   }
+
+}
+
+int main( int argc, char** argv ) {
+   const uint64_t operations = argc > 1 ? std::strtoull( argv[1], nullptr, 10 ) : 100000;
+   const uint64_t seed       = argc > 2 ? std::strtoull( argv[2], nullptr, 10 ) : std::random_device()();
+   std::mt19937_64 rng( seed );
+   std::printf( "seed %llu, %llu operations\n", (unsigned long long)seed, (unsigned long long)operations );
+
+   // market as created by init: 64 GiB of RAM against a thousandth of a 1e9 token supply
+   market<int64_t> m{ 100'000'000'000'000ll, 64ll * 1024 * 1024 * 1024, 1'000'000'0000ll };
+   market<real>    exact{ real(m.supply), real(m.base), real(m.quote) };
+
+   std::uniform_real_distribution<double> log_amount( 0, 10 ); // 0.0001 to 1000000 core tokens
+   conversion_stats buy_stats, sell_stats;
+   int64_t  bytes_held = 0;
+   uint64_t arbitrage = 0, arbitrage_after_fee = 0;
+   int64_t  max_gain = 0;
+
+   for( uint64_t i = 0; i < operations; ++i ) {
+      const bool round_trip = rng() % 4 == 0;
+      if( bytes_held == 0 || rng() % 2 == 0 || round_trip ) {
+         const int64_t quant = std::max<int64_t>( 2, int64_t( std::pow( 10.0, log_amount( rng ) ) ) );
+         const int64_t fee   = (quant + 199) / 200;
+         const int64_t paid  = quant - fee;
+         const int64_t bytes = convert( m, paid, true, buy_stats );
+         convert( exact, real(paid), true );
+         if( bytes <= 0 )
+            continue;
+
+         if( round_trip ) {
+            // sell right back what was bought
+            const int64_t tokens = convert( m, bytes, false, sell_stats );
+            convert( exact, real(bytes), false );
+            if( tokens > paid ) {
+               ++arbitrage;
+               max_gain = std::max( max_gain, tokens - paid );
+            }
+            if( tokens > quant ) {
+               ++arbitrage_after_fee;
+               std::printf( "round trip of %lld returned %lld\n", (long long)quant, (long long)tokens );
+            }
+         } else {
+            bytes_held += bytes;
+         }
+      } else {
+         const int64_t bytes = std::uniform_int_distribution<int64_t>( 1, bytes_held )( rng );
+         convert( m, bytes, false, sell_stats );
+         convert( exact, real(bytes), false );
+         bytes_held -= bytes;
+      }
+   }
+
+   buy_stats.print( "to exchange" );
+   sell_stats.print( "from exchange" );
+   std::printf( "drift of supply %s, ram %s, core %s against the market without truncation\n",
+                real( real(m.supply) - exact.supply ).str( 6 ).c_str(),
+                real( real(m.base)   - exact.base ).str( 6 ).c_str(),
+                real( real(m.quote)  - exact.quote ).str( 6 ).c_str() );
+   std::printf( "round trips returning more than paid after fee: %llu (max gain %lld), more than spent: %llu\n",
+                (unsigned long long)arbitrage, (long long)max_gain, (unsigned long long)arbitrage_after_fee );
+   int64_t sink = 0;
+   const auto start = std::chrono::steady_clock::now();
+   for( const auto& k : recorded ) {
+      sink += k.to_exchange ? native::convert_to_exchange( k.supply, k.balance, weight, k.in )
+                            : native::convert_from_exchange( k.supply, k.balance, weight, k.in );
+   }
+   const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+   std::printf( "kernel throughput %.2f Mconversions/s (checksum %lld)\n",
+                recorded.size() / elapsed.count() / 1e6, (long long)sink );
+   return arbitrage_after_fee ? 1 : 0;
+}
@@ -0,0 +1,234 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosio/chain/block_state.hpp>
+#include <eosio/chain/contract_table_objects.hpp>
+#include <eosio/chain/controller.hpp>
+#include <eosio/chain/trace.hpp>
+
+#include <fc/crypto/sha256.hpp>
+#include <fc/io/raw.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace eosio_system {
+
+using namespace eosio::chain;
+
+/**
+ *  Compact binary log of the transactions pushed to a tester chain, block by block.
+ *
+ *  Only input transactions whose actions all belong to `contracts` are kept, together with the number of
+ *  block slots between consecutive blocks, so that a replay starting from the same chain state produces
+ *  the same blocks at the same times. Signatures are not kept: the tester keys are derived from the account
+ *  and permission names, so the replay signs the transactions again. The digests of the contract tables at
+ *  the end of the recording are kept to check the replay for equivalence.
+ */
+struct replay_transaction {
+   vector<action> actions;
+};
+
+struct replay_block {
+   fc::unsigned_int           slots = 1; // since the previous block
+   vector<replay_transaction> transactions;
+};
+
+struct table_digest {
+   account_name code;
+   table_name   table;
+   uint32_t     rows = 0;
+   fc::sha256   hash;
+
+   bool operator==( const table_digest& o )const {
+      return code == o.code && table == o.table && rows == o.rows && hash == o.hash;
+   }
+};
+
+struct replay_log {
+   static constexpr uint32_t magic   = 0x4c505252; // "RRPL"
+   static constexpr uint32_t version = 1;
+
+   uint32_t             start_block_num = 0;
+   block_timestamp_type start_time;
+   vector<account_name> contracts;
+   vector<replay_block> blocks;
+   vector<table_digest> state;
+
+   void write( const std::string& path )const {
+      auto data = fc::raw::pack( std::make_pair( std::make_pair( magic, version ), *this ) );
+      std::ofstream out( path, std::ios::binary | std::ios::trunc );
+      out.write( data.data(), data.size() );
+      EOS_ASSERT( out.good(), fc::exception, "failed to write replay log ${p}", ("p", path) );
+   }
+
+   static replay_log read( const std::string& path ) {
+      std::ifstream in( path, std::ios::binary );
+      EOS_ASSERT( in.good(), fc::exception, "failed to open replay log ${p}", ("p", path) );
+      const vector<char> data( (std::istreambuf_iterator<char>( in )), std::istreambuf_iterator<char>() );
+      auto log = fc::raw::unpack<std::pair<std::pair<uint32_t, uint32_t>, replay_log>>( data );
+      EOS_ASSERT( log.first.first == magic && log.first.second == version, fc::exception,
+                  "${p} is not a replay log of version ${v}", ("p", path)("v", version) );
+      return log.second;
+   }
+
+   size_t transaction_count()const {
+      size_t count = 0;
+      for( const auto& b : blocks ) {
+         count += b.transactions.size();
+      }
+      return count;
+   }
+};
+
+/// digest of every table of the `codes`, over scope, primary key, payer and value of all rows
+inline vector<table_digest> contract_state_digest( const controller& control, const vector<account_name>& codes ) {
+   const auto& db     = control.db();
+   const auto& tables = db.get_index<table_id_multi_index, by_code_scope_table>();
+   const auto& rows   = db.get_index<key_value_index, by_scope_primary>();
+
+   std::map<std::pair<account_name, table_name>, std::pair<uint32_t, fc::sha256::encoder>> digests;
+   for( const auto& code : codes ) {
+      for( auto t = tables.lower_bound( boost::make_tuple( code ) ); t != tables.end() && t->code == code; ++t ) {
+         auto& d = digests[ { t->code, t->table } ];
+         for( auto r = rows.lower_bound( boost::make_tuple( t->id ) ); r != rows.end() && r->t_id == t->id; ++r ) {
+            ++d.first;
+            fc::raw::pack( d.second, uint64_t(t->scope) );
+            fc::raw::pack( d.second, r->primary_key );
+            fc::raw::pack( d.second, uint64_t(r->payer) );
+            d.second.write( r->value.data(), r->value.size() );
+         }
+      }
+   }
+
+   vector<table_digest> result;
+   for( auto& d : digests ) {
+      result.push_back( { d.first.first, d.first.second, d.second.first, d.second.second.result() } );
+   }
+   return result;
+}
+
+/**
+ *  Records the input transactions of every block accepted by `control` into a replay log, from the block after
+ *  the current head on. Deferred and failed transactions are not recorded, the replay runs them on its own.
+ */
+class action_recorder {
+public:
+   action_recorder( controller& control, vector<account_name> contracts )
+   :control( control ) {
+      log.start_block_num = control.head_block_num();
+      log.start_time      = control.head_block_state()->header.timestamp;
+      log.contracts       = std::move(contracts);
+      connection = control.accepted_block.connect( [this]( const block_state_ptr& bsp ) { on_block( bsp ); } );
+   }
+
+   ~action_recorder() {
+      connection.disconnect();
+   }
+
+   /// finishes the log with the digest of the contract tables at the current head
+   replay_log& finish() {
+      connection.disconnect();
+      log.state = contract_state_digest( control, log.contracts );
+      return log;
+   }
+
+private:
+   void on_block( const block_state_ptr& bsp ) {
+      replay_block b;
+      b.slots = bsp->header.timestamp.slot - last_slot();
+      for( const auto& receipt : bsp->block->transactions ) {
+         if( receipt.status != transaction_receipt::executed || !receipt.trx.contains<packed_transaction>() )
+            continue;
+         auto actions = receipt.trx.get<packed_transaction>().get_transaction().actions;
+         const bool recorded = std::all_of( actions.begin(), actions.end(), [&]( const action& a ) {
+            return std::find( log.contracts.begin(), log.contracts.end(), a.account ) != log.contracts.end();
+         });
+         if( recorded ) {
+            b.transactions.push_back( { std::move(actions) } );
+         }
+      }
+      log.blocks.push_back( std::move(b) );
+      slot = bsp->header.timestamp.slot;
+   }
+
+   uint32_t last_slot()const {
+      return log.blocks.empty() ? log.start_time.slot : slot;
+   }
+
+   controller&                  control;
+   replay_log                   log;
+   uint32_t                     slot = 0;
+   boost::signals2::connection  connection;
+};
+
+/**
+ *  Billed CPU of replayed transactions per action type, in power of two buckets of microseconds.
+ */
+class cpu_histogram {
+public:
+   void add( const std::string& label, uint32_t cpu_us ) {
+      types[label].push_back( cpu_us );
+   }
+
+   void print( std::ostream& out )const {
+      char line[160];
+      std::snprintf( line, sizeof(line), "%-40s %8s %8s %8s %8s %8s\n", "action", "count", "p50_us", "p90_us", "p99_us", "max_us" );
+      out << line;
+      for( const auto& t : types ) {
+         auto s = t.second;
+         std::sort( s.begin(), s.end() );
+         auto pct = [&]( double p ) { return s[ std::min<size_t>( s.size() - 1, size_t( p * s.size() ) ) ]; };
+         std::snprintf( line, sizeof(line), "%-40s %8zu %8u %8u %8u %8u\n", t.first.c_str(), s.size(),
+                        pct( 0.5 ), pct( 0.9 ), pct( 0.99 ), s.back() );
+         out << line;
+
+         for( const auto& b : buckets( s ) ) {
+            std::snprintf( line, sizeof(line), "   <= %8u us %8u %s\n", b.first, b.second,
+                           std::string( std::max<size_t>( 1, 50 * b.second / s.size() ), '#' ).c_str() );
+            out << line;
+         }
+      }
+   }
+
+   /// one row per action type and bucket: action,bucket_us,count
+   void write_csv( const std::string& path )const {
+      std::ofstream out( path );
+      out << "action,bucket_us,count\n";
+      for( const auto& t : types ) {
+         for( const auto& b : buckets( t.second ) ) {
+            out << t.first << ',' << b.first << ',' << b.second << '\n';
+         }
+      }
+   }
+
+   std::map<std::string, vector<uint32_t>> types;
+
+private:
+   /// sample counts by the smallest power of two not below the sample
+   static std::map<uint32_t, uint32_t> buckets( const vector<uint32_t>& samples ) {
+      std::map<uint32_t, uint32_t> result;
+      for( auto us : samples ) {
+         uint32_t upper = 1;
+         while( upper < us ) upper <<= 1;
+         ++result[upper];
+      }
+      return result;
+   }
+};
+
+} // namespace eosio_system
+
+FC_REFLECT( eosio_system::replay_transaction, (actions) )
+FC_REFLECT( eosio_system::replay_block, (slots)(transactions) )
+FC_REFLECT( eosio_system::table_digest, (code)(table)(rows)(hash) )
+FC_REFLECT( eosio_system::replay_log, (start_block_num)(start_time)(contracts)(blocks)(state) )
@@ -0,0 +1,172 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosio/chain/trace.hpp>
+
+#include <boost/algorithm/string.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace eosio_system {
+
+using eosio::chain::action_trace;
+using eosio::chain::transaction_trace_ptr;
+
+/**
+ * Benchmark configuration read from the environment, so that the same binary can compare contract builds:
+ *
+ *  - BENCH_TABLE_SIZES  comma separated table sizes the actions are measured at, default "10,100"
+ *  - BENCH_ITERATIONS   measured transactions per action and table size, default 5
+ *  - BENCH_REPORT       report path, JSON if it ends with ".json", CSV otherwise, default "benchmark_report.csv"
+ *
+ * and for the scaling benchmarks:
+ *
+ *  - BENCH_VOTERS       comma separated voter populations, default "100,1000"
+ *  - BENCH_PRODUCERS    registered producers, default 50
+ *  - BENCH_PROXIED      percentage of voters voting through a proxy, default 10
+ */
+struct benchmark_config {
+   std::vector<uint32_t> table_sizes = { 10, 100 };
+   uint32_t              iterations  = 5;
+   std::string           report_path = "benchmark_report.csv";
+   std::vector<uint32_t> voter_populations = { 100, 1000 };
+   uint32_t              producers   = 50;
+   uint32_t              proxied_percent = 10;
+
+   static benchmark_config from_env() {
+      benchmark_config cfg;
+      read_list( "BENCH_TABLE_SIZES", cfg.table_sizes );
+      read_list( "BENCH_VOTERS", cfg.voter_populations );
+      if( const char* iterations = std::getenv( "BENCH_ITERATIONS" ) ) {
+         cfg.iterations = std::max( 1ul, std::stoul( iterations ) );
+      }
+      if( const char* path = std::getenv( "BENCH_REPORT" ) ) {
+         cfg.report_path = path;
+      }
+      if( const char* producers = std::getenv( "BENCH_PRODUCERS" ) ) {
+         cfg.producers = std::max( 1ul, std::stoul( producers ) );
+      }
+      if( const char* proxied = std::getenv( "BENCH_PROXIED" ) ) {
+         cfg.proxied_percent = std::min( 100ul, std::stoul( proxied ) );
+      }
+      return cfg;
+   }
+
+private:
+   static void read_list( const char* var, std::vector<uint32_t>& list ) {
+      if( const char* value = std::getenv( var ) ) {
+         std::vector<std::string> parts;
+         boost::split( parts, value, boost::is_any_of(",") );
+         list.clear();
+         for( const auto& p : parts ) {
+            if( !p.empty() )
+               list.push_back( std::stoul( p ) );
+         }
+         std::sort( list.begin(), list.end() );
+      }
+   }
+};
+
+/**
+ * Resource usage of one measured transaction. Everything is taken from the transaction trace:
+ * billed CPU and NET from the receipt, wall clock time spent executing the actions, the number
+ * of actions executed including inline ones and the RAM usage change summed over all accounts.
+ */
+struct benchmark_sample {
+   std::string action;
+   uint32_t    table_size = 0;
+   uint32_t    cpu_usage_us = 0;
+   uint32_t    net_usage_words = 0;
+   int64_t     elapsed_us = 0;
+   uint32_t    actions = 0;
+   int64_t     ram_delta = 0;
+};
+
+class benchmark_report {
+public:
+   void record( const std::string& action, uint32_t table_size, const transaction_trace_ptr& trace ) {
+      benchmark_sample s;
+      s.action     = action;
+      s.table_size = table_size;
+      if( trace->receipt ) {
+         s.cpu_usage_us    = trace->receipt->cpu_usage_us;
+         s.net_usage_words = trace->receipt->net_usage_words;
+      }
+      s.elapsed_us = trace->elapsed.count();
+      for( const auto& at : trace->action_traces ) {
+         count( at, s );
+      }
+      samples.push_back( s );
+   }
+
+   /// writes one row per action and table size with the mean and max over all iterations
+   void write( const std::string& path )const {
+      std::ofstream out( path );
+      const bool json = boost::algorithm::ends_with( path, ".json" );
+
+      std::map<std::pair<std::string, uint32_t>, std::vector<const benchmark_sample*>> groups;
+      for( const auto& s : samples ) {
+         groups[ { s.action, s.table_size } ].push_back( &s );
+      }
+
+      if( json ) {
+         out << "[\n";
+      } else {
+         out << "action,table_size,iterations,cpu_us_mean,cpu_us_max,net_words_mean,elapsed_us_mean,actions,ram_delta_mean\n";
+      }
+      bool first = true;
+      for( const auto& g : groups ) {
+         const auto& v = g.second;
+         double cpu = 0, net = 0, elapsed = 0, ram = 0;
+         uint32_t cpu_max = 0, actions = 0;
+         for( const auto* s : v ) {
+            cpu     += s->cpu_usage_us;
+            net     += s->net_usage_words;
+            elapsed += s->elapsed_us;
+            ram     += s->ram_delta;
+            cpu_max  = std::max( cpu_max, s->cpu_usage_us );
+            actions  = std::max( actions, s->actions );
+         }
+         const double n = v.size();
+         if( json ) {
+            out << (first ? "" : ",\n")
+                << "  {\"action\": \"" << g.first.first << "\", \"table_size\": " << g.first.second
+                << ", \"iterations\": " << v.size()
+                << ", \"cpu_us_mean\": " << cpu / n << ", \"cpu_us_max\": " << cpu_max
+                << ", \"net_words_mean\": " << net / n << ", \"elapsed_us_mean\": " << elapsed / n
+                << ", \"actions\": " << actions << ", \"ram_delta_mean\": " << ram / n << "}";
+         } else {
+            out << g.first.first << ',' << g.first.second << ',' << v.size() << ','
+                << cpu / n << ',' << cpu_max << ',' << net / n << ',' << elapsed / n << ','
+                << actions << ',' << ram / n << '\n';
+         }
+         first = false;
+      }
+      if( json ) {
+         out << "\n]\n";
+      }
+   }
+
+   std::vector<benchmark_sample> samples;
+
+private:
+   static void count( const action_trace& at, benchmark_sample& s ) {
+      ++s.actions;
+      for( const auto& d : at.account_ram_deltas ) {
+         s.ram_delta += d.delta;
+      }
+      for( const auto& inl : at.inline_traces ) {
+         count( inl, s );
+      }
+   }
+};
+
+} // namespace eosio_system
@@ -0,0 +1,417 @@
+#include "eosio.system_tester.hpp"
+#include "benchmark_report.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <random>
+
+//XXX: run with BENCH_TABLE_SIZES, BENCH_ITERATIONS and BENCH_REPORT set, see benchmark_report.hpp
+
+using namespace eosio_system;
+
+namespace {
+
+benchmark_config& bench_config() {
+   static benchmark_config cfg = benchmark_config::from_env();
+   return cfg;
+}
+
+benchmark_report& bench_report() {
+   static benchmark_report report;
+   return report;
+}
+
+struct benchmark_report_writer {
+   ~benchmark_report_writer() {
+      if( !bench_report().samples.empty() ) {
+         bench_report().write( bench_config().report_path );
+         std::cout << "benchmark report written to " << bench_config().report_path << std::endl;
+      }
+   }
+};
+
+}
+
+BOOST_GLOBAL_FIXTURE( benchmark_report_writer );
+
+class eosio_system_benchmark : public eosio_system_tester {
+public:
+
+   eosio_system_benchmark() {
+      control->applied_transaction.connect( [&]( const transaction_trace_ptr& t ) {
+         if( !t->action_traces.empty() && t->action_traces[0].act.name == N(onblock) ) {
+            onblock_trace = t;
+         }
+      });
+   }
+
+   /// pushes the actions in one transaction signed by all `signers` and returns the trace with objectively billed CPU
+   transaction_trace_ptr push_signed( vector<action>&& actions, const vector<account_name>& signers ) {
+      signed_transaction trx;
+      trx.actions = std::move(actions);
+      set_transaction_headers( trx );
+      for( const auto& s : std::set<account_name>( signers.begin(), signers.end() ) ) {
+         trx.sign( get_private_key( s, "active" ), control->get_chain_id() );
+      }
+      auto trace = push_transaction( trx, fc::time_point::maximum(), 0 );
+      produce_block();
+      return trace;
+   }
+
+   transaction_trace_ptr measure( const std::string& label, uint32_t table_size,
+                                  const account_name& code, const action_name& act,
+                                  const account_name& signer, const variant_object& data ) {
+      auto trace = push_signed( { get_action( code, act, { { signer, config::active_name } }, data ) }, { signer } );
+      BOOST_REQUIRE( trace->receipt && trace->receipt->status == transaction_receipt::executed );
+      bench_report().record( label, table_size, trace );
+      return trace;
+   }
+
+   /**
+    *  Produces blocks until `count` producer schedule updates happened and records their onblock traces.
+    *  Traces of the blocks in between are recorded as `plain_label` unless it is empty.
+    */
+   void measure_schedule_updates( const std::string& label, const std::string& plain_label, uint32_t table_size, uint32_t count ) {
+      for( uint32_t updates = 0; updates < count; ) {
+         const auto last_update = get_global_row().last_producer_schedule_update;
+         onblock_trace.reset();
+         produce_block();
+         BOOST_REQUIRE( onblock_trace );
+         const bool updated = last_update.slot != get_global_row().last_producer_schedule_update.slot;
+         if( updated ) {
+            bench_report().record( label, table_size, onblock_trace );
+            ++updates;
+         } else if( !plain_label.empty() ) {
+            bench_report().record( plain_label, table_size, onblock_trace );
+         }
+      }
+   }
+
+   /// creates accounts owning staked tokens (and voting power) transferred from eosio, in chunks of one transaction each
+   void add_voters( uint32_t count ) {
+      while( voters.size() < count ) {
+         vector<action> actions;
+         for( uint32_t i = 0; i < chunk_size && voters.size() < count; ++i ) {
+            const auto a = indexed_name( "benchv", voters.size() );
+            create_account_actions( a, STRSYM("10.0000"), actions );
+            voters.push_back( a );
+         }
+         push_signed( std::move(actions), { config::system_account_name } );
+      }
+   }
+
+   void add_producers( uint32_t count ) {
+      while( producers.size() < count ) {
+         vector<action> actions;
+         vector<account_name> created;
+         for( uint32_t i = 0; i < chunk_size && producers.size() + created.size() < count; ++i ) {
+            const auto a = indexed_name( "benchp", producers.size() + created.size() );
+            create_account_actions( a, STRSYM("0.0000"), actions );
+            created.push_back( a );
+         }
+         push_signed( std::move(actions), { config::system_account_name } );
+
+         actions.clear();
+         for( const auto& p : created ) {
+            actions.push_back( get_action( config::system_account_name, N(regproducer), { { p, config::active_name } }, mvo()
+                                           ("producer",     p)
+                                           ("producer_key", get_public_key( p, "active" ))
+                                           ("url",          "")
+                                           ("location",     0) ) );
+         }
+         push_signed( std::move(actions), created );
+         producers.insert( producers.end(), created.begin(), created.end() );
+      }
+   }
+
+   /// stakes and votes enough for the chain to start paying producers, a vote names a single producer
+   void activate_chain() {
+      transfer( "eosio", "alice1111111", STRSYM("30000200.0000"), "eosio" );
+      BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", STRSYM("100.0000"), STRSYM("100.0000"), STRSYM("30000000.0000") ) );
+      BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), { producers.front() } ) );
+   }
+
+   const uint32_t chunk_size = 50;
+   transaction_trace_ptr onblock_trace;
+   vector<account_name> voters;
+   vector<account_name> producers;
+
+private:
+   void create_account_actions( const account_name& a, const asset& vote, vector<action>& actions ) {
+      const account_name creator = config::system_account_name;
+      actions.emplace_back( vector<permission_level>{ { creator, config::active_name } },
+                            newaccount{
+                               .creator  = creator,
+                               .name     = a,
+                               .owner    = authority( get_public_key( a, "owner" ) ),
+                               .active   = authority( get_public_key( a, "active" ) )
+                            });
+      actions.push_back( get_action( config::system_account_name, N(buyram), { { creator, config::active_name } }, mvo()
+                                     ("payer",    creator)
+                                     ("receiver", a)
+                                     ("quant",    STRSYM("1.0000")) ) );
+      actions.push_back( get_action( config::system_account_name, N(delegatebw), { { creator, config::active_name } }, mvo()
+                                     ("from",                creator)
+                                     ("receiver",            a)
+                                     ("stake_net_quantity",  STRSYM("10.0000"))
+                                     ("stake_cpu_quantity",  STRSYM("10.0000"))
+                                     ("stake_vote_quantity", vote)
+                                     ("transfer",            true) ) );
+   }
+};
+
+BOOST_AUTO_TEST_SUITE(eosio_system_benchmarks)
+
+BOOST_FIXTURE_TEST_CASE( delegatebw_benchmark, eosio_system_benchmark ) try {
+   const auto& cfg = bench_config();
+   for( auto size : cfg.table_sizes ) {
+      add_voters( size );
+      for( uint32_t i = 0; i < cfg.iterations; ++i ) {
+         measure( "delegatebw", size, config::system_account_name, N(delegatebw), config::system_account_name, mvo()
+                  ("from",                "eosio")
+                  ("receiver",            voters[i % size])
+                  ("stake_net_quantity",  STRSYM("1.0000"))
+                  ("stake_cpu_quantity",  STRSYM("1.0000"))
+                  ("stake_vote_quantity", STRSYM("1.0000"))
+                  ("transfer",            true) );
+      }
+   }
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( voteproducer_benchmark, eosio_system_benchmark ) try {
+   const auto& cfg = bench_config();
+   add_voters( cfg.iterations );
+   for( auto size : cfg.table_sizes ) {
+      add_producers( size );
+      // every voter votes for a single producer, rotating through the producers to spread the votes
+      for( uint32_t i = 0; i < cfg.iterations; ++i ) {
+         measure( "voteproducer", size, config::system_account_name, N(voteproducer), voters[i], mvo()
+                  ("voter",     voters[i])
+                  ("proxy",     name(0).to_string())
+                  ("producers", vector<account_name>{ producers[i % size] }) );
+      }
+   }
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( claimrewards_benchmark, eosio_system_benchmark ) try {
+   const auto& cfg = bench_config();
+   add_producers( cfg.table_sizes.front() );
+   activate_chain();
+   for( auto size : cfg.table_sizes ) {
+      add_producers( size );
+      produce_blocks( 250 );
+      produce_block( fc::days(1) );
+      for( uint32_t i = 0; i < std::min( cfg.iterations, size ); ++i ) {
+         measure( "claimrewards", size, config::system_account_name, N(claimrewards), producers[i], mvo()
+                  ("owner", producers[i]) );
+      }
+   }
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( onblock_benchmark, eosio_system_benchmark ) try {
+   const auto& cfg = bench_config();
+   add_producers( cfg.table_sizes.front() );
+   activate_chain();
+
+   for( auto size : cfg.table_sizes ) {
+      add_producers( size );
+      // schedule updates run every 120 slots and are measured separately from plain blocks
+      measure_schedule_updates( "onblock_schedule_update", "onblock", size, cfg.iterations );
+   }
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( buyram_benchmark, eosio_system_benchmark ) try {
+   const auto& cfg = bench_config();
+   for( auto size : cfg.table_sizes ) {
+      add_voters( size );
+      for( uint32_t i = 0; i < cfg.iterations; ++i ) {
+         measure( "buyram", size, config::system_account_name, N(buyram), config::system_account_name, mvo()
+                  ("payer",    "eosio")
+                  ("receiver", voters[i % size])
+                  ("quant",    STRSYM("1.0000")) );
+      }
+   }
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( bidname_benchmark, eosio_system_benchmark ) try {
+   const auto& cfg = bench_config();
+   transfer( "eosio", "alice1111111", STRSYM("1000000.0000"), "eosio" );
+   uint32_t bids = 0;
+   for( auto size : cfg.table_sizes ) {
+      for( ; bids < size; ++bids ) {
+         BOOST_REQUIRE_EQUAL( success(), bidname( "alice1111111", indexed_name( "bid", bids ).to_string(), STRSYM("1.0000") ) );
+      }
+      for( uint32_t i = 0; i < cfg.iterations; ++i, ++bids ) {
+         measure( "bidname", size, config::system_account_name, N(bidname), N(alice1111111), mvo()
+                  ("bidder",  "alice1111111")
+                  ("newname", indexed_name( "bid", bids ))
+                  ("bid",     STRSYM("1.0000")) );
+      }
+   }
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( msig_benchmark, eosio_system_benchmark ) try {
+   const auto& cfg = bench_config();
+   initialize_multisig();
+   transfer( "eosio", "alice1111111", STRSYM("1000000.0000"), "eosio" );
+
+   transaction proposed;
+   proposed.actions.push_back( get_action( N(eosio.token), N(transfer), { { N(alice1111111), config::active_name } }, mvo()
+                                           ("from",     "alice1111111")
+                                           ("to",       "bob111111111")
+                                           ("quantity", STRSYM("0.0001"))
+                                           ("memo",     "") ) );
+   const vector<permission_level> requested{ { N(alice1111111), config::active_name } };
+
+   uint32_t proposals = 0;
+   auto propose = [&]( const std::string& label, uint32_t size ) {
+      proposed.expiration = control->head_block_time() + fc::hours(1);
+      const auto data = mvo()
+         ("proposer",      "alice1111111")
+         ("proposal_name", indexed_name( "prop", proposals++ ))
+         ("requested",     requested)
+         ("trx",           proposed);
+      if( label.empty() ) {
+         push_signed( { get_action( N(eosio.msig), N(propose), { { N(alice1111111), config::active_name } }, data ) }, { N(alice1111111) } );
+      } else {
+         measure( label, size, N(eosio.msig), N(propose), N(alice1111111), data );
+      }
+   };
+
+   for( auto size : cfg.table_sizes ) {
+      while( proposals < size ) {
+         propose( "", size );
+      }
+      for( uint32_t i = 0; i < cfg.iterations; ++i ) {
+         const auto proposal = indexed_name( "prop", proposals );
+         propose( "msig_propose", size );
+         measure( "msig_approve", size, N(eosio.msig), N(approve), N(alice1111111), mvo()
+                  ("proposer",      "alice1111111")
+                  ("proposal_name", proposal)
+                  ("level",         requested[0]) );
+         measure( "msig_exec", size, N(eosio.msig), N(exec), N(alice1111111), mvo()
+                  ("proposer",      "alice1111111")
+                  ("proposal_name", proposal)
+                  ("executer",      "alice1111111") );
+      }
+   }
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( transfer_benchmark, eosio_system_benchmark ) try {
+   const auto& cfg = bench_config();
+   transfer( "eosio", "alice1111111", STRSYM("1000000.0000"), "eosio" );
+   uint32_t holders = 0;
+   for( auto size : cfg.table_sizes ) {
+      add_voters( std::max( size, holders ) + cfg.iterations );
+      for( ; holders < size; ++holders ) {
+         transfer( "eosio", voters[holders], STRSYM("1.0000"), "eosio" );
+      }
+      for( uint32_t i = 0; i < cfg.iterations; ++i ) {
+         // to a holder and to a new balance row
+         measure( "transfer", size, N(eosio.token), N(transfer), N(alice1111111), mvo()
+                  ("from",     "alice1111111")
+                  ("to",       voters[i])
+                  ("quantity", STRSYM("1.0000"))
+                  ("memo",     "") );
+         measure( "transfer_new_holder", size, N(eosio.token), N(transfer), N(alice1111111), mvo()
+                  ("from",     "alice1111111")
+                  ("to",       voters[holders++])
+                  ("quantity", STRSYM("1.0000"))
+                  ("memo",     "") );
+      }
+   }
+} FC_LOG_AND_RETHROW()
+
+/**
+ *  Voting and election costs as the voter population grows. Proxies cannot vote through another proxy,
+ *  so proxy load is modelled by a share of the population voting through one proxy instead of by chain depth.
+ */
+BOOST_FIXTURE_TEST_CASE( scaling_benchmark, eosio_system_benchmark ) try {
+   const auto& cfg = bench_config();
+   std::mt19937 rng( 0 );
+   /// a vote names a single producer
+   auto pick_producer = [&]() {
+      vector<account_name> picked;
+      std::sample( producers.begin(), producers.end(), std::back_inserter( picked ), 1, rng );
+      return picked;
+   };
+   auto vote_action = [&]( const account_name& voter, const account_name& proxy, const vector<account_name>& voted ) {
+      return get_action( config::system_account_name, N(voteproducer), { { voter, config::active_name } }, mvo()
+                         ("voter",     voter)
+                         ("proxy",     proxy)
+                         ("producers", voted) );
+   };
+   auto stake_action = [&]( const account_name& receiver ) {
+      return mvo()
+         ("from",                "eosio")
+         ("receiver",            receiver)
+         ("stake_net_quantity",  STRSYM("0.0000"))
+         ("stake_cpu_quantity",  STRSYM("0.0000"))
+         ("stake_vote_quantity", STRSYM("1.0000"))
+         ("transfer",            true);
+   };
+
+   add_producers( cfg.producers );
+   activate_chain();
+
+   const account_name proxy = N(carol1111111);
+   BOOST_REQUIRE_EQUAL( success(), push_action( proxy, N(regproxy), mvo()("proxy", proxy)("isproxy", true) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( proxy, pick_producer() ) );
+
+   vector<account_name> direct, proxied;
+   uint32_t voted = 0;
+   for( auto population : cfg.voter_populations ) {
+      add_voters( population );
+      while( voted < population ) {
+         vector<action> actions;
+         vector<account_name> signers;
+         for( uint32_t i = 0; i < chunk_size && voted < population; ++i, ++voted ) {
+            const auto& v = voters[voted];
+            if( voted % 100 < cfg.proxied_percent ) {
+               actions.push_back( vote_action( v, proxy, {} ) );
+               proxied.push_back( v );
+            } else {
+               actions.push_back( vote_action( v, name(0), pick_producer() ) );
+               direct.push_back( v );
+            }
+            signers.push_back( v );
+         }
+         push_signed( std::move(actions), signers );
+      }
+
+      for( uint32_t i = 0; i < cfg.iterations; ++i ) {
+         if( !direct.empty() ) {
+            const auto& v = direct[i % direct.size()];
+            measure( "scale_voteproducer", population, config::system_account_name, N(voteproducer), v, mvo()
+                     ("voter",     v)
+                     ("proxy",     name(0))
+                     ("producers", pick_producer()) );
+            // stake change of a voter updates its producer
+            measure( "scale_delegatebw_voter", population, config::system_account_name, N(delegatebw),
+                     config::system_account_name, stake_action( v ) );
+         }
+         if( !proxied.empty() ) {
+            // and of a proxied voter propagates through the proxy
+            measure( "scale_delegatebw_proxied", population, config::system_account_name, N(delegatebw),
+                     config::system_account_name, stake_action( proxied[i % proxied.size()] ) );
+         }
+         measure( "scale_proxy_vote", population, config::system_account_name, N(voteproducer), proxy, mvo()
+                  ("voter",     proxy)
+                  ("proxy",     name(0))
+                  ("producers", pick_producer()) );
+      }
+
+      measure_schedule_updates( "scale_update_elected_producers", "", population, cfg.iterations );
+
+      produce_block( fc::days(1) );
+      for( uint32_t i = 0; i < std::min( cfg.iterations, cfg.producers ); ++i ) {
+         measure( "scale_claimrewards", population, config::system_account_name, N(claimrewards), producers[i], mvo()
+                  ("owner", producers[i]) );
+      }
+   }
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,377 @@
+#include "eosio.system_tester.hpp"
+#include "action_replay.hpp"
+#include "ram_footprint.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <fc/io/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+/**
+ *  Records system, token and msig traffic into a replay log and replays it against candidate contract builds.
+ *
+ *  - REPLAY_LOG           log path, default "action_replay.bin"; the replay generates a synthetic log if it does not exist
+ *  - REPLAY_SEED          seed of the synthetic traffic, default 0
+ *  - REPLAY_TRANSACTIONS  number of synthetic operations, default 1000
+ *  - REPLAY_HISTOGRAM     optional CSV path for the CPU histograms of the replay
+ *  - REPLAY_RAM_REPORT    CSV path of the RAM footprint report after the replay, default "ram_footprint.csv"
+ *  - REPLAY_SYSTEM_WASM, REPLAY_SYSTEM_ABI, REPLAY_TOKEN_WASM, REPLAY_TOKEN_ABI, REPLAY_MSIG_WASM, REPLAY_MSIG_ABI
+ *                         candidate contract builds replacing the ones of this build during the replay
+ *
+ *  Any test can record its own traffic the same way `record_synthetic` does, with an action_recorder attached
+ *  to a fixture prepared by `prepare()`.
+ */
+
+using namespace eosio_system;
+
+namespace {
+
+std::string env_or( const char* var, const std::string& def ) {
+   const char* value = std::getenv( var );
+   return value ? std::string( value ) : def;
+}
+
+std::string replay_log_path() {
+   return env_or( "REPLAY_LOG", "action_replay.bin" );
+}
+
+struct candidate_contract {
+   vector<uint8_t> wasm;
+   vector<char>    abi; // json
+};
+
+}
+
+class eosio_system_replay : public eosio_system_tester {
+public:
+
+   const vector<account_name> contracts = { config::system_account_name, N(eosio.token), N(eosio.msig) };
+
+   /**
+    *  Installs the candidate contracts read from REPLAY_* and produces the block a log starts after.
+    *  The msig contract is installed by the recorded traffic, the replay substitutes the candidate there.
+    */
+   void prepare( bool use_candidates ) {
+      if( use_candidates ) {
+         read_candidate( config::system_account_name, "REPLAY_SYSTEM_WASM", "REPLAY_SYSTEM_ABI" );
+         read_candidate( N(eosio.token), "REPLAY_TOKEN_WASM", "REPLAY_TOKEN_ABI" );
+         read_candidate( N(eosio.msig), "REPLAY_MSIG_WASM", "REPLAY_MSIG_ABI" );
+         for( const auto& c : candidates ) {
+            if( c.first == N(eosio.msig) )
+               continue;
+            const auto& accnt = control->db().get<account_object,by_name>( c.first );
+            if( !c.second.wasm.empty() && accnt.code_version != fc::sha256::hash( (const char*)c.second.wasm.data(), c.second.wasm.size() ) ) {
+               set_code( c.first, c.second.wasm );
+            }
+            if( !c.second.abi.empty() ) {
+               set_abi( c.first, c.second.abi.data() );
+            }
+         }
+      }
+      produce_block();
+      load_abi( N(eosio.token), token_abi_ser );
+      load_abi( config::system_account_name, abi_ser );
+   }
+
+   /// synthetic mix of token, resource, voting, name auction and msig operations
+   void generate_traffic( uint32_t seed, uint32_t operations ) {
+      std::mt19937 rng( seed );
+      auto uniform = [&]( uint32_t lo, uint32_t hi ) { return std::uniform_int_distribution<uint32_t>( lo, hi )( rng ); };
+      auto amount  = [&]( int64_t lo, int64_t hi ) {
+         return asset( std::uniform_int_distribution<int64_t>( lo, hi )( rng ), symbol{CORE_SYM} );
+      };
+      // system actions report their failures in the action result, the token and msig helpers throw
+      auto attempt = [&]( auto&& op ) {
+         try {
+            if( op() != success() ) {
+               ++failed;
+            }
+         } catch( const fc::exception& ) {
+            ++failed;
+         }
+      };
+
+      vector<account_name> users, producers;
+      for( uint32_t i = 0; i < 30; ++i ) {
+         producers.push_back( indexed_name( "replayp", i ) );
+         create_account_with_resources( producers.back(), config::system_account_name );
+      }
+      for( uint32_t i = 0; i < 50; ++i ) {
+         users.push_back( indexed_name( "replayu", i ) );
+         create_account_with_resources( users.back(), config::system_account_name );
+      }
+      produce_block();
+      for( const auto& p : producers ) {
+         regproducer( p );
+      }
+      std::sort( producers.begin(), producers.end() );
+      for( const auto& u : users ) {
+         transfer( config::system_account_name, u, STRSYM("10000.0000"), config::system_account_name );
+      }
+      produce_block();
+
+      // stake and vote enough for the chain to start paying producers, every voter votes for a single producer
+      transfer( "eosio", "alice1111111", STRSYM("30000200.0000"), "eosio" );
+      BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", STRSYM("100.0000"), STRSYM("100.0000"), STRSYM("30000000.0000") ) );
+      BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), { producers.front() } ) );
+      initialize_multisig();
+
+      auto pick = [&]( const vector<account_name>& from ) { return from[ uniform( 0, from.size() - 1 ) ]; };
+      uint32_t bids = 0, proposals = 0;
+      std::discrete_distribution<uint32_t> mix{ 30, 12, 6, 10, 6, 18, 6, 6, 6 };
+
+      for( uint32_t i = 0; i < operations; ++i ) {
+         const auto user = pick( users );
+         switch( mix( rng ) ) {
+         case 0:
+            attempt( [&] { transfer( user, pick( users ), amount( 1, 10000 ), user ); return success(); } );
+            break;
+         case 1:
+            attempt( [&] { return stake( user, amount( 0, 10000 ), amount( 0, 10000 ), amount( 1, 10000 ) ); } );
+            break;
+         case 2:
+            attempt( [&] { return unstake( user, amount( 0, 1000 ), amount( 0, 1000 ), amount( 1, 1000 ) ); } );
+            break;
+         case 3:
+            attempt( [&] { return buyram( user, user, amount( 1000, 10000 ) ); } );
+            break;
+         case 4:
+            attempt( [&] { return sellram( user, uniform( 100, 1000 ) ); } );
+            break;
+         case 5: {
+            const auto producer = pick( producers );
+            attempt( [&] { return vote( user, { producer } ); } );
+            break;
+         }
+         case 6: {
+            const auto owner = pick( producers );
+            attempt( [&] { return push_action( owner, N(claimrewards), mvo()("owner", owner) ); } );
+            break;
+         }
+         case 7:
+            attempt( [&] { return bidname( user, indexed_name( "rbid", bids++ ), amount( 10000, 20000 ) ); } );
+            break;
+         case 8:
+            attempt( [&] { propose_approve_exec( user, pick( users ), indexed_name( "rprop", proposals++ ) ); return success(); } );
+            break;
+         }
+
+         if( uniform( 0, 4 ) == 0 ) {
+            produce_block();
+         }
+         if( uniform( 0, 999 ) == 0 ) {
+            // now and then a gap of a few hours, so that rewards can be claimed again
+            produce_block();
+            produce_block( fc::hours( uniform( 1, 24 ) ) );
+         }
+      }
+      produce_block();
+   }
+
+   void propose_approve_exec( const account_name& proposer, const account_name& to, const account_name& proposal ) {
+      transaction proposed;
+      proposed.expiration = control->head_block_time() + fc::hours(1);
+      proposed.actions.push_back( get_action( N(eosio.token), N(transfer), { { proposer, config::active_name } }, mvo()
+                                              ("from",     proposer)
+                                              ("to",       to)
+                                              ("quantity", STRSYM("0.0001"))
+                                              ("memo",     "") ) );
+      const vector<permission_level> requested{ { proposer, config::active_name } };
+      base_tester::push_action( N(eosio.msig), N(propose), proposer, mvo()
+                                ("proposer",      proposer)
+                                ("proposal_name", proposal)
+                                ("requested",     requested)
+                                ("trx",           proposed) );
+      base_tester::push_action( N(eosio.msig), N(approve), proposer, mvo()
+                                ("proposer",      proposer)
+                                ("proposal_name", proposal)
+                                ("level",         requested[0]) );
+      base_tester::push_action( N(eosio.msig), N(exec), proposer, mvo()
+                                ("proposer",      proposer)
+                                ("proposal_name", proposal)
+                                ("executer",      proposer) );
+   }
+
+   /// pushes the recorded transactions block by block, at the recorded block times and with objectively billed CPU
+   void replay( const replay_log& log, cpu_histogram& histogram ) {
+      BOOST_REQUIRE_MESSAGE( control->head_block_num() == log.start_block_num
+                             && control->head_block_state()->header.timestamp == log.start_time,
+                             "the replay log was recorded from a different chain state" );
+
+      for( const auto& b : log.blocks ) {
+         const auto time = block_timestamp_type( control->head_block_state()->header.timestamp.slot + b.slots.value ).to_time_point();
+         if( !b.transactions.empty() ) {
+            _start_block( time );
+         }
+         for( const auto& t : b.transactions ) {
+            signed_transaction trx;
+            trx.actions    = substitute_candidates( t.actions );
+            trx.expiration = time + fc::seconds( DEFAULT_EXPIRATION_DELTA );
+            trx.set_reference_block( control->head_block_id() );
+
+            std::set<permission_level> signers;
+            std::string label;
+            for( const auto& a : trx.actions ) {
+               signers.insert( a.authorization.begin(), a.authorization.end() );
+               label += ( label.empty() ? "" : "+" ) + a.account.to_string() + "::" + a.name.to_string();
+            }
+            for( const auto& s : signers ) {
+               trx.sign( get_private_key( s.actor, s.permission.to_string() ), control->get_chain_id() );
+            }
+
+            try {
+               auto trace = push_transaction( trx, fc::time_point::maximum(), 0 );
+               histogram.add( label, trace->receipt->cpu_usage_us );
+            } catch( const fc::exception& ex ) {
+               if( failed++ < 10 ) {
+                  std::cout << "replayed " << label << " failed: " << ex.top_message() << std::endl;
+               }
+            }
+            ++replayed;
+         }
+         produce_block( time - control->head_block_time() );
+      }
+   }
+
+   uint32_t failed   = 0;
+   uint32_t replayed = 0;
+
+private:
+   void read_candidate( const account_name& account, const char* wasm_var, const char* abi_var ) {
+      candidate_contract c;
+      if( const char* wasm = std::getenv( wasm_var ) ) {
+         c.wasm = read_wasm( wasm );
+      }
+      if( const char* abi = std::getenv( abi_var ) ) {
+         c.abi = read_abi( abi );
+         c.abi.push_back( '\0' );
+      }
+      if( !c.wasm.empty() || !c.abi.empty() ) {
+         candidates[account] = std::move(c);
+      }
+   }
+
+   /// recorded setcode and setabi of accounts with a candidate build install the candidate instead
+   vector<action> substitute_candidates( vector<action> actions )const {
+      for( auto& a : actions ) {
+         if( a.account != config::system_account_name )
+            continue;
+         if( a.name == setcode::get_name() ) {
+            auto act = a.data_as<setcode>();
+            auto c = candidates.find( act.account );
+            if( c != candidates.end() && !c->second.wasm.empty() ) {
+               act.code.assign( c->second.wasm.begin(), c->second.wasm.end() );
+               a.data = fc::raw::pack( act );
+            }
+         } else if( a.name == setabi::get_name() ) {
+            auto act = a.data_as<setabi>();
+            auto c = candidates.find( act.account );
+            if( c != candidates.end() && !c->second.abi.empty() ) {
+               act.abi = fc::raw::pack( fc::json::from_string( c->second.abi.data() ).as<abi_def>() );
+               a.data = fc::raw::pack( act );
+            }
+         }
+      }
+      return actions;
+   }
+
+   std::map<account_name, candidate_contract> candidates;
+};
+
+namespace {
+
+void record_synthetic_log( const std::string& path ) {
+   const uint32_t seed       = std::stoul( env_or( "REPLAY_SEED", "0" ) );
+   const uint32_t operations = std::stoul( env_or( "REPLAY_TRANSACTIONS", "1000" ) );
+
+   eosio_system_replay t;
+   t.prepare( false );
+   action_recorder recorder( *t.control, t.contracts );
+   t.generate_traffic( seed, operations );
+   const auto& log = recorder.finish();
+   log.write( path );
+   std::cout << "recorded " << log.transaction_count() << " transactions in " << log.blocks.size() << " blocks to " << path
+             << " (seed " << seed << ", " << t.failed << " of " << operations << " operations failed)" << std::endl;
+}
+
+replay_log read_or_record_log() {
+   const auto path = replay_log_path();
+   if( !fc::exists( path ) ) {
+      record_synthetic_log( path );
+   }
+   return replay_log::read( path );
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(eosio_system_replay_tests)
+
+BOOST_AUTO_TEST_CASE( record_synthetic ) try {
+   record_synthetic_log( replay_log_path() );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( replay ) try {
+   const auto log = read_or_record_log();
+
+   eosio_system_replay t;
+   t.prepare( true );
+   cpu_histogram histogram;
+   const auto start = std::chrono::steady_clock::now();
+   t.replay( log, histogram );
+   const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+   histogram.print( std::cout );
+   if( const char* csv = std::getenv( "REPLAY_HISTOGRAM" ) ) {
+      histogram.write_csv( csv );
+   }
+   std::cout << "replayed " << t.replayed << " transactions in " << log.blocks.size() << " blocks in " << elapsed.count()
+             << " s (" << t.replayed / elapsed.count() << " trx/s), " << t.failed << " failed" << std::endl;
+
+   const auto state = contract_state_digest( *t.control, log.contracts );
+   std::map<std::pair<account_name, table_name>, table_digest> recorded, replayed;
+   for( const auto& d : log.state ) recorded[ { d.code, d.table } ] = d;
+   for( const auto& d : state )     replayed[ { d.code, d.table } ] = d;
+   for( const auto& r : recorded ) {
+      auto itr = replayed.find( r.first );
+      if( itr == replayed.end() || !( itr->second == r.second ) ) {
+         std::cout << "table " << r.first.first << "::" << r.first.second << " differs: " << r.second.rows << " rows recorded, "
+                   << ( itr == replayed.end() ? 0 : itr->second.rows ) << " rows replayed" << std::endl;
+      }
+   }
+   for( const auto& r : replayed ) {
+      if( !recorded.count( r.first ) ) {
+         std::cout << "table " << r.first.first << "::" << r.first.second << " only exists in the replay" << std::endl;
+      }
+   }
+   BOOST_CHECK_MESSAGE( state == log.state, "contract state after the replay differs from the recorded state" );
+} FC_LOG_AND_RETHROW()
+
+/// row counts, row size distributions, billed bytes per table and payer and compaction candidates after the replay
+BOOST_AUTO_TEST_CASE( ram_footprint ) try {
+   const auto log = read_or_record_log();
+
+   eosio_system_replay t;
+   t.prepare( true );
+   cpu_histogram histogram;
+   t.replay( log, histogram );
+
+   ram_footprint_report report;
+   report.collect( *t.control, t.contracts, t.abi_serializer_max_time );
+   report.print( std::cout );
+   const auto path = env_or( "REPLAY_RAM_REPORT", "ram_footprint.csv" );
+   report.write_csv( path );
+   std::cout << "RAM footprint report written to " << path << std::endl;
+
+   // the footprint is only meaningful for the recorded traffic, in which every voter votes for a single producer
+   BOOST_REQUIRE_EQUAL( 0u, t.failed );
+   const auto& voters = report.usages.at( { config::system_account_name, N(voters) } );
+   BOOST_REQUIRE( !voters.row_sizes.empty() );
+   BOOST_CHECK_LE( voters.fields.at( "producers" ).bytes, voters.row_sizes.size() * ( 1 + sizeof(uint64_t) ) );
+   BOOST_REQUIRE( report.usages.count( { config::system_account_name, N(producers) } ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
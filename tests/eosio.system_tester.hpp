@@ -6,12 +6,26 @@
 
 #include <eosio/testing/tester.hpp>
 #include <eosio/chain/abi_serializer.hpp>
+#include <eosio/chain/chain_snapshot.hpp>
 #include <eosio/chain/resource_limits.hpp>
+#include <eosio/chain/snapshot.hpp>
 #include "contracts.hpp"
+#include "system_rows.hpp"
 #include "test_symbol.hpp"
 
+#include <boost/filesystem.hpp>
+#include <fc/crypto/sha256.hpp>
+#include <fc/filesystem.hpp>
 #include <fc/variant_object.hpp>
+#include <cstdlib>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <sstream>
+
+#include <unistd.h>
 
 using namespace eosio::chain;
 using namespace eosio::testing;
@@ -55,12 +69,7 @@ public:
       produce_blocks( 100 );
       set_code( N(eosio.token), contracts::token_wasm());
       set_abi( N(eosio.token), contracts::token_abi().data() );
-      {
-         const auto& accnt = control->db().get<account_object,by_name>( N(eosio.token) );
-         abi_def abi;
-         BOOST_REQUIRE_EQUAL(abi_serializer::to_abi(accnt.abi, abi), true);
-         token_abi_ser.set_abi(abi, abi_serializer_max_time);
-      }
+      load_abi( N(eosio.token), token_abi_ser );
    }
 
    void create_core_token( symbol core_symbol = symbol{CORE_SYM} ) {
@@ -81,17 +90,29 @@ public:
          );
       }
 
-      {
-         const auto& accnt = control->db().get<account_object,by_name>( config::system_account_name );
+      load_abi( config::system_account_name, abi_ser );
+   }
+
+   /// serializers are cached by ABI, so that fixtures restored from the setup snapshot do not validate the ABIs again
+   void load_abi( const account_name& account, abi_serializer& ser ) {
+      static std::map<fc::sha256, abi_serializer> cache;
+      const auto& accnt = control->db().get<account_object,by_name>( account );
+      const auto key = fc::sha256::hash( accnt.abi.data(), accnt.abi.size() );
+      auto itr = cache.find( key );
+      if( itr == cache.end() ) {
          abi_def abi;
          BOOST_REQUIRE_EQUAL(abi_serializer::to_abi(accnt.abi, abi), true);
-         abi_ser.set_abi(abi, abi_serializer_max_time);
+         itr = cache.emplace( key, abi_serializer( abi, abi_serializer_max_time ) ).first;
       }
+      ser = itr->second;
    }
 
    void remaining_setup() {
       produce_blocks();
+      create_setup_accounts();
+   }
 
+   void create_setup_accounts() {
       // Assumes previous setup steps were done with core token symbol set to CORE_SYM
       create_account_with_resources( N(alice1111111), config::system_account_name, STRSYM("1.0000"), false );
       create_account_with_resources( N(bob111111111), config::system_account_name, STRSYM("0.4500"), false );
@@ -110,17 +131,21 @@ public:
 
    eosio_system_tester( setup_level l = setup_level::full ) {
       if( l == setup_level::none ) return;
+      if( l != setup_level::full || !restore_setup_snapshot() ) {
+         basic_setup();
+         if( l == setup_level::minimal ) return;
 
-      basic_setup();
-      if( l == setup_level::minimal ) return;
-
-      create_core_token();
-      if( l == setup_level::core_token ) return;
+         create_core_token();
+         if( l == setup_level::core_token ) return;
 
-      deploy_contract();
-      if( l == setup_level::deploy_contract ) return;
+         deploy_contract();
+         if( l == setup_level::deploy_contract ) return;
 
-      remaining_setup();
+         produce_blocks();
+         save_setup_snapshot();
+      }
+      // pushed after the snapshot, so that restored fixtures start with the same pending block as fresh ones
+      create_setup_accounts();
    }
 
    template<typename Lambda>
@@ -134,6 +159,183 @@ public:
    }
 
 
+   /**
+    * The full setup is the same for most test cases, so the chain state after it is kept as a snapshot
+    * in memory and in the temp directory and restored instead of replaying the setup transactions.
+    * The key covers the system and token contracts, this file, the eosio version and the controller
+    * config, so a rebuild or an upgrade invalidates the cache. Snapshots that fail to load are dropped
+    * and the setup runs from genesis. Set EOSIO_SYSTEM_TESTER_NO_SNAPSHOT to run the setup every time.
+    */
+   static bool setup_snapshots_enabled() {
+      return std::getenv( "EOSIO_SYSTEM_TESTER_NO_SNAPSHOT" ) == nullptr;
+   }
+
+   fc::sha256 setup_snapshot_key()const {
+      static const std::string code = []() {
+         std::string code;
+         const auto system_wasm = contracts::system_wasm();
+         const auto system_abi  = contracts::system_abi();
+         const auto token_wasm  = contracts::token_wasm();
+         const auto token_abi   = contracts::token_abi();
+         code.append( (const char*)system_wasm.data(), system_wasm.size() );
+         code.append( system_abi.data(), system_abi.size() );
+         code.append( (const char*)token_wasm.data(), token_wasm.size() );
+         code.append( token_abi.data(), token_abi.size() );
+         std::ifstream self( __FILE__, std::ios::binary );
+         code.append( (std::istreambuf_iterator<char>( self )), std::istreambuf_iterator<char>() );
+         return code;
+      }();
+
+      fc::sha256::encoder enc;
+      enc.write( code.data(), code.size() );
+      const std::string version = chain_version;
+      enc.write( version.data(), version.size() );
+      const uint32_t snapshot_version = chain_snapshot_header::current_version;
+      fc::raw::pack( enc, snapshot_version );
+      fc::raw::pack( enc, cfg.genesis );
+      fc::raw::pack( enc, static_cast<uint32_t>( cfg.wasm_runtime ) );
+      fc::raw::pack( enc, cfg.contracts_console );
+      fc::raw::pack( enc, static_cast<uint32_t>( cfg.read_mode ) );
+      return enc.result();
+   }
+
+   static std::string setup_snapshot_prefix() {
+      return "eosio_system_tester.";
+   }
+
+   fc::path setup_snapshot_path()const {
+      return fc::temp_directory_path() / ( setup_snapshot_prefix() + setup_snapshot_key().str() + ".snapshot" );
+   }
+
+   static std::map<fc::sha256, std::shared_ptr<const std::string>>& setup_snapshots() {
+      static std::map<fc::sha256, std::shared_ptr<const std::string>> snapshots;
+      return snapshots;
+   }
+
+   std::shared_ptr<const std::string> find_setup_snapshot() {
+      auto& snapshots = setup_snapshots();
+      auto itr = snapshots.find( setup_snapshot_key() );
+      if( itr != snapshots.end() ) {
+         return itr->second;
+      }
+      std::ifstream in( setup_snapshot_path().generic_string(), std::ios::binary );
+      if( !in ) {
+         return {};
+      }
+      auto snapshot = std::make_shared<const std::string>( (std::istreambuf_iterator<char>( in )), std::istreambuf_iterator<char>() );
+      snapshots[ setup_snapshot_key() ] = snapshot;
+      return snapshot;
+   }
+
+   void drop_setup_snapshot() {
+      setup_snapshots().erase( setup_snapshot_key() );
+      boost::system::error_code ec;
+      boost::filesystem::remove( setup_snapshot_path(), ec );
+   }
+
+   /// removes the snapshots of other builds left in the temp directory
+   void remove_stale_setup_snapshots() {
+      const auto prefix  = setup_snapshot_prefix();
+      const auto current = setup_snapshot_path().filename().generic_string();
+      boost::system::error_code ec;
+      for( boost::filesystem::directory_iterator itr( fc::temp_directory_path(), ec ), end; !ec && itr != end; itr.increment( ec ) ) {
+         const auto file = itr->path().filename().generic_string();
+         if( file.compare( 0, prefix.size(), prefix ) == 0 && file != current ) {
+            boost::system::error_code remove_ec;
+            boost::filesystem::remove( itr->path(), remove_ec );
+         }
+      }
+   }
+
+   void save_setup_snapshot() {
+      if( !setup_snapshots_enabled() || setup_snapshots().count( setup_snapshot_key() ) ) {
+         return;
+      }
+      control->abort_block();
+      std::ostringstream out;
+      auto writer = std::make_shared<ostream_snapshot_writer>( out );
+      control->write_snapshot( writer );
+      writer->finalize();
+      auto snapshot = std::make_shared<const std::string>( out.str() );
+      setup_snapshots()[ setup_snapshot_key() ] = snapshot;
+
+      // write and rename, so that concurrently running test processes never read a partial file
+      remove_stale_setup_snapshots();
+      const auto path = setup_snapshot_path();
+      const auto tmp  = fc::path( path.generic_string() + "." + std::to_string( ::getpid() ) );
+      {
+         std::ofstream file( tmp.generic_string(), std::ios::binary | std::ios::trunc );
+         file.write( snapshot->data(), snapshot->size() );
+      }
+      fc::rename( tmp, path );
+   }
+
+   bool restore_setup_snapshot() {
+      if( !setup_snapshots_enabled() ) {
+         return false;
+      }
+      const auto snapshot = find_setup_snapshot();
+      if( !snapshot ) {
+         return false;
+      }
+
+      // a truncated or incompatible snapshot is rejected before the chain is touched
+      try {
+         std::istringstream in( *snapshot );
+         istream_snapshot_reader( in ).validate();
+      } catch( ... ) {
+         drop_setup_snapshot();
+         return false;
+      }
+
+      try {
+         restore_chain( snapshot );
+      } catch( ... ) {
+         drop_setup_snapshot();
+         restore_chain( nullptr );
+         push_genesis_block();
+         return false;
+      }
+
+      load_abi( N(eosio.token), token_abi_ser );
+      load_abi( config::system_account_name, abi_ser );
+      return true;
+   }
+
+   /// restarts both nodes from `snapshot`, or from genesis if it is null
+   void restore_chain( const std::shared_ptr<const std::string>& snapshot ) {
+      close();
+      fc::remove_all( cfg.blocks_dir );
+      fc::remove_all( cfg.state_dir );
+      std::istringstream in( snapshot ? *snapshot : std::string() );
+      open( snapshot ? std::make_shared<istream_snapshot_reader>( in ) : snapshot_reader_ptr() );
+      restore_validating_node( *this, snapshot );
+      last_produced_block.clear();
+   }
+
+   static void restore_validating_node( base_tester&, const std::shared_ptr<const std::string>& ) {}
+
+   static void restore_validating_node( validating_tester& t, const std::shared_ptr<const std::string>& snapshot ) {
+      t.validating_node.reset();
+      fc::remove_all( t.vcfg.blocks_dir );
+      fc::remove_all( t.vcfg.state_dir );
+      std::istringstream in( snapshot ? *snapshot : std::string() );
+      t.validating_node = std::make_unique<controller>( t.vcfg );
+      t.validating_node->add_indices();
+      t.validating_node->startup( snapshot ? std::make_shared<istream_snapshot_reader>( in ) : snapshot_reader_ptr() );
+   }
+
+   /// deterministic account names: prefix followed by the index in base 31 over [a-z1-5]
+   static account_name indexed_name( const std::string& prefix, uint32_t i ) {
+      static const char chars[] = "abcdefghijklmnopqrstuvwxyz12345";
+      std::string suffix;
+      do {
+         suffix.insert( suffix.begin(), chars[i % 31] );
+         i /= 31;
+      } while( i );
+      return account_name( prefix + suffix );
+   }
+
    void create_accounts_with_resources( const vector<account_name>& accounts, const account_name& creator = config::system_account_name ) {
       for( const auto& a : accounts ) {
          create_account_with_resources( a, creator );
@@ -391,9 +593,135 @@ public:
                          ("producers", producers));
    }
 
+   action_result bulkclaim( const std::vector<account_name>& owners ) {
+      action act;
+      act.account = config::system_account_name;
+      act.name = N(bulkclaim);
+      act.data = abi_ser.variant_to_binary( "bulkclaim", mvo()("owners", owners), abi_serializer_max_time );
+
+      std::set<account_name> signers( owners.begin(), owners.end() );
+      for( const auto& s : signers ) {
+         act.authorization.emplace_back( s, config::active_name );
+      }
+
+      signed_transaction trx;
+      trx.actions.emplace_back( std::move(act) );
+      set_transaction_headers( trx );
+      for( const auto& s : signers ) {
+         trx.sign( get_private_key( s, "active" ), control->get_chain_id() );
+      }
+      try {
+         push_transaction( trx );
+      } catch( const fc::exception& ex ) {
+         return error( ex.top_message() );
+      }
+      produce_block();
+      return success();
+   }
+
+   /**
+    *  Decodes the row with primary key `primary` straight into one of the rows:: mirrors of the contract structs,
+    *  without copying the value or going through the ABI.
+    */
+   template<typename Row>
+   std::optional<Row> read_row( const account_name& code, uint64_t scope, const name& table, uint64_t primary )const {
+      const auto& db = control->db();
+      const auto* t_id = db.find<table_id_object, by_code_scope_table>( boost::make_tuple( code, scope, table ) );
+      if( !t_id ) {
+         return {};
+      }
+      const auto* obj = db.find<key_value_object, by_scope_primary>( boost::make_tuple( t_id->id, primary ) );
+      if( !obj ) {
+         return {};
+      }
+      fc::datastream<const char*> ds( obj->value.data(), obj->value.size() );
+      Row row;
+      fc::raw::unpack( ds, row );
+      return row;
+   }
+
+   /// account billed for a row of a contract table
+   std::optional<account_name> row_payer( const account_name& code, uint64_t scope, const name& table, uint64_t primary )const {
+      const auto& db = control->db();
+      const auto* t_id = db.find<table_id_object, by_code_scope_table>( boost::make_tuple( code, scope, table ) );
+      if( !t_id ) {
+         return {};
+      }
+      const auto* obj = db.find<key_value_object, by_scope_primary>( boost::make_tuple( t_id->id, primary ) );
+      if( !obj ) {
+         return {};
+      }
+      return obj->payer;
+   }
+
+   std::optional<rows::voter_info> get_voter_row( const account_name& act )const {
+      return read_row<rows::voter_info>( config::system_account_name, config::system_account_name, N(voters), act );
+   }
+
+   std::optional<rows::producer_info> get_producer_row( const account_name& act )const {
+      return read_row<rows::producer_info>( config::system_account_name, config::system_account_name, N(producers), act );
+   }
+
+   std::optional<rows::producer_info2> get_producer2_row( const account_name& act )const {
+      return read_row<rows::producer_info2>( config::system_account_name, config::system_account_name, N(producers2), act );
+   }
+
+   std::optional<rows::proxy_follower> get_proxy_follower_row( const account_name& proxy, const account_name& follower )const {
+      return read_row<rows::proxy_follower>( config::system_account_name, proxy, N(proxyfollow), follower );
+   }
+
+   std::optional<rows::autopay_info> get_autopay_row( const account_name& producer )const {
+      return read_row<rows::autopay_info>( config::system_account_name, config::system_account_name, N(autopay), producer );
+   }
+
+   std::optional<rows::maintenance_task> get_maintenance_task_row( const account_name& task )const {
+      return read_row<rows::maintenance_task>( config::system_account_name, config::system_account_name, N(maintasks), task );
+   }
+
+   std::optional<rows::proxy_stats> get_proxy_stats_row( const account_name& proxy )const {
+      return read_row<rows::proxy_stats>( config::system_account_name, config::system_account_name, N(proxystats), proxy );
+   }
+
+   rows::eosio_global_state get_global_row()const {
+      return *read_row<rows::eosio_global_state>( config::system_account_name, config::system_account_name, N(global), N(global) );
+   }
+
+   rows::eosio_global_state2 get_global2_row()const {
+      return *read_row<rows::eosio_global_state2>( config::system_account_name, config::system_account_name, N(global2), N(global2) );
+   }
+
+   rows::eosio_global_state3 get_global3_row()const {
+      return *read_row<rows::eosio_global_state3>( config::system_account_name, config::system_account_name, N(global3), N(global3) );
+   }
+
+   rows::eosio_global_state4 get_global4_row()const {
+      return *read_row<rows::eosio_global_state4>( config::system_account_name, config::system_account_name, N(global4), N(global4) );
+   }
+
+   std::optional<rows::election_cache> get_election_cache_row()const {
+      return read_row<rows::election_cache>( config::system_account_name, config::system_account_name, N(electcache), N(electcache) );
+   }
+
+   std::optional<rows::election_preview> get_election_preview_row()const {
+      return read_row<rows::election_preview>( config::system_account_name, config::system_account_name, N(electpreview), N(electpreview) );
+   }
+
+   std::optional<rows::user_resources> get_user_resources_row( const account_name& act )const {
+      return read_row<rows::user_resources>( config::system_account_name, act, N(userres), act );
+   }
+
+   std::optional<rows::refund_request> get_refund_row( const account_name& act )const {
+      return read_row<rows::refund_request>( config::system_account_name, act, N(refunds), act );
+   }
+
+   std::optional<rows::currency_stats> get_stats_row( const symbol& sym )const {
+      const auto code = sym.to_symbol_code().value;
+      return read_row<rows::currency_stats>( N(eosio.token), code, N(stat), code );
+   }
+
    asset get_balance( const account_name& act, symbol balance_symbol = symbol{CORE_SYM} ) const {
-      vector<char> data = get_row_by_account( N(eosio.token), act, N(accounts), balance_symbol.to_symbol_code().value );
-      return data.empty() ? asset(0, balance_symbol) : token_abi_ser.binary_to_variant("account", data, abi_serializer_max_time)["balance"].as<asset>();
+      const auto row = read_row<rows::account>( N(eosio.token), act, N(accounts), balance_symbol.to_symbol_code().value );
+      return row ? row->balance : asset(0, balance_symbol);
    }
 
    fc::variant get_total_stake( const account_name& act ) const {
@@ -416,6 +744,13 @@ public:
       return abi_ser.binary_to_variant( "producer_info2", data, abi_serializer_max_time );
    }
 
+   /// vote-seconds taken off the votepay share the producer accrued since producers2 was last written
+   double votepay_share_offset( const account_name& producer )const {
+      const auto row = read_row<rows::producer_votepay_offset>( config::system_account_name, config::system_account_name,
+                                                                N(votepayoff), producer );
+      return row ? row->offset : 0.0;
+   }
+
    fc::variant get_name_bid( const account_name& act ) const {
       vector<char> data = get_row_by_account( config::system_account_name, act, N(namebids), act );
       return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "name_bid_table", data, abi_serializer_max_time );
@@ -481,7 +816,7 @@ public:
    }
 
    asset get_token_supply() {
-      return get_stats("4," CORE_SYM_NAME)["supply"].as<asset>();
+      return get_stats_row( symbol{CORE_SYM} )->supply;
    }
 
    uint64_t microseconds_since_epoch_of_iso_string( const fc::variant& v ) {
@@ -504,6 +839,16 @@ public:
       return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "eosio_global_state3", data, abi_serializer_max_time );
    }
 
+   fc::variant get_global_state4() {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(global4), N(global4) );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "eosio_global_state4", data, abi_serializer_max_time );
+   }
+
+   fc::variant get_election_cache() {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(electcache), N(electcache) );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "election_cache", data, abi_serializer_max_time );
+   }
+
    fc::variant get_refund_request( name account ) {
       vector<char> data = get_row_by_account( config::system_account_name, account, N(refunds), account );
       return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "refund_request", data, abi_serializer_max_time );
@@ -12,8 +12,12 @@
 #include <boost/range/adaptor/transformed.hpp>
 #include <boost/test/unit_test.hpp>
 
+#include <eosio.system/emission.hpp>
+
 #include <cstdlib>
 #include <iostream>
+#include <limits>
+#include <random>
 #include <sstream>
 
 //XXX: run tests with --log_level=message (or below) to see BOOST_TEST_MESSAGE output
@@ -1186,6 +1190,34 @@ double get_continuous_rate(double emission_rate) {
    return (pow(1 + emission_rate, 1./blocks_per_hour) - 1) * blocks_per_hour;
 }
 
+BOOST_AUTO_TEST_CASE( fixed_point_emission_drift ) try {
+   namespace em = eosiosystem::emission;
+   const int64_t usecs_per_year = 52 * 7 * 24 * 3600 * 1000000ll;
+
+   // the curve ends match up to the rate precision (pow based rates lose a few ulps in the subtraction)
+   BOOST_REQUIRE( std::abs( em::continuous_rates.front() - get_continuous_rate(0.2) * em::rate_precision ) <= 2 );
+   BOOST_REQUIRE( std::abs( em::continuous_rates.back()  - get_continuous_rate(0.1) * em::rate_precision ) <= 2 );
+
+   std::mt19937_64 rng( 42 );
+   for( int i = 0; i < 100000; ++i ) {
+      const int64_t supply       = std::uniform_int_distribution<int64_t>( 10'000'000'0000ll, 100'000'000'000'0000ll )( rng );
+      const int64_t active_stake = std::uniform_int_distribution<int64_t>( 0, supply )( rng );
+      const int64_t usecs        = std::uniform_int_distribution<int64_t>( 500000, 3 * usecs_per_year )( rng );
+
+      const double  rate     = get_continuous_rate( get_target_emission_per_year( 1.0 * active_stake / supply ) );
+      const double  expected = rate * supply * usecs / usecs_per_year;
+      const int64_t actual   = em::get_emission( em::get_continuous_rate( active_stake, supply ), supply, usecs );
+
+      // rate interpolation is good to 1e-8, i.e. about 1e-7 of the emitted amount, plus truncation
+      BOOST_TEST_REQUIRE( std::abs( actual - expected ) <= 2e-7 * expected + 2 );
+   }
+
+   // exact integer arithmetic even where double products lose precision
+   const int64_t max_supply = std::numeric_limits<int64_t>::max() / 4;
+   BOOST_REQUIRE_EQUAL( em::get_emission( em::rate_precision, max_supply, usecs_per_year ), max_supply );
+   BOOST_REQUIRE_EQUAL( em::get_emission( em::rate_precision / 2, max_supply, 2 * usecs_per_year ), max_supply );
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE( token_emission, eosio_system_tester, * boost::unit_test::tolerance(1e-3) ) try {
     cross_15_percent_threshold();
 
@@ -1720,6 +1752,7 @@ BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::uni
 
       const auto     initial_prod_info         = get_producer_info(prod_name);
       const auto     initial_prod_info2        = get_producer_info2(prod_name);
+      const double   initial_votepay_offset    = votepay_share_offset(prod_name);
       const auto     initial_global_state      = get_global_state();
       const double   initial_tot_votepay_share = get_global_state2()["total_producer_votepay_share"].as_double();
       const double   initial_tot_vpay_rate     = get_global_state3()["total_vpay_share_change_rate"].as_double();
@@ -1763,7 +1796,8 @@ BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::uni
       const uint64_t usecs_between_fills         = bucket_fill_time - initial_bucket_fill_time;
       const double   secs_between_global_updates = (vpay_state_update - initial_vpay_state_update) / 1E6;
       const double   secs_between_prod_updates   = (prod_update_time - initial_prod_update_time) / 1E6;
-      const double   votepay_share               = initial_prod_info2["votepay_share"].as_double() + secs_between_prod_updates * prod_info["total_votes"].as_double();
+      const double   votepay_share               = initial_prod_info2["votepay_share"].as_double() + secs_between_prod_updates * prod_info["total_votes"].as_double()
+                                                    - initial_votepay_offset;
       const double   tot_votepay_share           = initial_tot_votepay_share + initial_tot_vpay_rate * secs_between_global_updates;
 
       const auto to_producers = newly_minted - to_dao;
@@ -2010,7 +2044,8 @@ BOOST_FIXTURE_TEST_CASE(votepay_share_invariant, eosio_system_tester, * boost::u
    double expected_total_vpay_share = info2["votepay_share"].as_double()
                                        + info["total_votes"].as_double()
                                           * ( microseconds_since_epoch_of_iso_string( gs3["last_vpay_state_update"] )
-                                               - microseconds_since_epoch_of_iso_string( info2["last_votepay_share_update"] ) ) / 1E6;
+                                               - microseconds_since_epoch_of_iso_string( info2["last_votepay_share_update"] ) ) / 1E6
+                                       - votepay_share_offset( prodb );
 
    BOOST_TEST_REQUIRE( expected_total_vpay_share == gs2["total_producer_votepay_share"].as_double() );
 
@@ -3739,4 +3774,747 @@ BOOST_FIXTURE_TEST_CASE( total_activated_stake_fix, eosio_system_tester ) try {
    BOOST_TEST_REQUIRE( total_activated_before == get_global_state()["total_activated_stake"].as<int64_t>() );
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( election_cache, eosio_system_tester, * boost::unit_test::tolerance(1e+5) ) try {
+   create_accounts_with_resources( {  N(defproducer1), N(defproducer2), N(defproducer3) } );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer1", 1) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer2", 2) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer3", 3) );
+
+   // cache is built on the first schedule update
+   BOOST_REQUIRE( get_election_cache().is_null() );
+   transfer( "eosio", "alice1111111", STRSYM("30000200.0000"), "eosio" );
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", STRSYM("100.0000"), STRSYM("100.0000"), STRSYM("30000000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), { N(defproducer1) } ) );
+   produce_blocks(250);
+
+   auto cache = get_election_cache();
+   BOOST_REQUIRE( !cache.is_null() );
+   BOOST_REQUIRE_EQUAL( 1, cache["candidates"].get_array().size() );
+   BOOST_REQUIRE_EQUAL( "defproducer1", cache["candidates"][0]["owner"].as_string() );
+   BOOST_REQUIRE_EQUAL( get_global_state()["target_producer_schedule_size"].as<uint16_t>() + 10, cache["capacity"].as<uint16_t>() );
+
+   // votes are tracked without waiting for the schedule update
+   issue( "bob111111111", STRSYM("80200.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", STRSYM("100.0000"), STRSYM("100.0000"), STRSYM("80000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(defproducer2) } ) );
+   cache = get_election_cache();
+   BOOST_REQUIRE_EQUAL( 2, cache["candidates"].get_array().size() );
+   BOOST_REQUIRE_EQUAL( "defproducer1", cache["candidates"][0]["owner"].as_string() );
+   BOOST_REQUIRE_EQUAL( "defproducer2", cache["candidates"][1]["owner"].as_string() );
+   BOOST_TEST_REQUIRE( stake2votes(STRSYM("80000.0000")) == cache["candidates"][1]["total_votes"].as_double() );
+
+   produce_blocks(250);
+   auto producer_keys = control->head_block_state()->active_schedule.producers;
+   BOOST_REQUIRE_EQUAL( 2, producer_keys.size() );
+   BOOST_REQUIRE_EQUAL( name("defproducer1"), producer_keys[0].producer_name );
+   BOOST_REQUIRE_EQUAL( name("defproducer2"), producer_keys[1].producer_name );
+
+   // a vote change which keeps the rank of the candidate leaves the cache as it is
+   cache = get_election_cache();
+   issue( "bob111111111", STRSYM("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", STRSYM("0.0000"), STRSYM("0.0000"), STRSYM("1000.0000") ) );
+   BOOST_TEST_REQUIRE( stake2votes(STRSYM("81000.0000")) == get_producer_info( "defproducer2" )["total_votes"].as_double() );
+   BOOST_REQUIRE_EQUAL( fc::json::to_string( cache ), fc::json::to_string( get_election_cache() ) );
+
+   // deactivated producers leave the cache
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(defproducer2), N(unregprod), mvo()("producer", "defproducer2") ) );
+   cache = get_election_cache();
+   BOOST_REQUIRE_EQUAL( 1, cache["candidates"].get_array().size() );
+   BOOST_REQUIRE_EQUAL( "defproducer1", cache["candidates"][0]["owner"].as_string() );
+
+   // and come back on re-registration
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer2" ) );
+   cache = get_election_cache();
+   BOOST_REQUIRE_EQUAL( 2, cache["candidates"].get_array().size() );
+
+   // explicit rescan agrees with the incrementally maintained cache
+   BOOST_REQUIRE_EQUAL( error("missing authority of eosio"), push_action( N(alice1111111), N(rebuildelect), mvo() ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(rebuildelect), mvo() ) );
+   BOOST_REQUIRE_EQUAL( fc::json::to_string( cache ), fc::json::to_string( get_election_cache() ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( schedule_order_by_location, eosio_system_tester ) try {
+   const std::vector<account_name> producers = { N(defproducer1), N(defproducer2), N(defproducer3) };
+   const std::vector<uint16_t> locations = { 30, 10, 20 };
+   create_accounts_with_resources( producers );
+   for( size_t i = 0; i < producers.size(); ++i ) {
+      BOOST_REQUIRE_EQUAL( success(), push_action( producers[i], N(regproducer), mvo()
+                                                   ("producer",  producers[i] )
+                                                   ("producer_key", get_public_key( producers[i], "active" ) )
+                                                   ("url", "" )
+                                                   ("location", locations[i] ) ) );
+   }
+
+   transfer( "eosio", "alice1111111", STRSYM("30000200.0000"), "eosio" );
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", STRSYM("100.0000"), STRSYM("100.0000"), STRSYM("30000000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), { N(defproducer1) } ) );
+   for( const auto& p : { N(defproducer2), N(defproducer3) } ) {
+      issue( p, STRSYM("80200.0000"),  config::system_account_name );
+      BOOST_REQUIRE_EQUAL( success(), stake( p, STRSYM("100.0000"), STRSYM("100.0000"), STRSYM("80000.0000") ) );
+      BOOST_REQUIRE_EQUAL( success(), vote( p, { p } ) );
+   }
+   produce_blocks(250);
+
+   // name order by default
+   auto producer_keys = control->head_block_state()->active_schedule.producers;
+   BOOST_REQUIRE_EQUAL( 3, producer_keys.size() );
+   BOOST_REQUIRE_EQUAL( name("defproducer1"), producer_keys[0].producer_name );
+   BOOST_REQUIRE_EQUAL( name("defproducer2"), producer_keys[1].producer_name );
+   BOOST_REQUIRE_EQUAL( name("defproducer3"), producer_keys[2].producer_name );
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of eosio"), push_action( N(alice1111111), N(setprodorder), mvo()("order", 1) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("unknown schedule order"),
+                        push_action( config::system_account_name, N(setprodorder), mvo()("order", 2) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setprodorder), mvo()("order", 1) ) );
+   BOOST_REQUIRE_EQUAL( 1, get_global_state4()["schedule_order"].as<uint8_t>() );
+   produce_blocks(250);
+
+   producer_keys = control->head_block_state()->active_schedule.producers;
+   BOOST_REQUIRE_EQUAL( 3, producer_keys.size() );
+   BOOST_REQUIRE_EQUAL( name("defproducer2"), producer_keys[0].producer_name );
+   BOOST_REQUIRE_EQUAL( name("defproducer3"), producer_keys[1].producer_name );
+   BOOST_REQUIRE_EQUAL( name("defproducer1"), producer_keys[2].producer_name );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( producer_autopay, eosio_system_tester ) try {
+   const asset large_asset = STRSYM("80.0000");
+   create_account_with_resources( N(defproducera), config::system_account_name, STRSYM("1.0000"), false, large_asset, large_asset );
+   create_account_with_resources( N(producvotera), config::system_account_name, STRSYM("1.0000"), false, large_asset, large_asset );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("producer not found"),
+                        push_action( N(defproducera), N(setautopay), mvo()("producer", "defproducera")("enabled", true) ) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(defproducera) ) );
+   BOOST_REQUIRE_EQUAL( error("missing authority of defproducera"),
+                        push_action( N(producvotera), N(setautopay), mvo()("producer", "defproducera")("enabled", true) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(defproducera), N(setautopay), mvo()("producer", "defproducera")("enabled", true) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("automatic payouts are already enabled"),
+                        push_action( N(defproducera), N(setautopay), mvo()("producer", "defproducera")("enabled", true) ) );
+
+   transfer( config::system_account_name, "producvotera", STRSYM("60000000.0000"), config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "producvotera", STRSYM("10.0000"), STRSYM("10.0000"), STRSYM("30000000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(producvotera), { N(defproducera) } ) );
+
+   // nothing is paid automatically until the batch size is set
+   produce_blocks(250);
+   BOOST_REQUIRE_EQUAL( 0, get_balance( N(defproducera) ).get_amount() );
+   BOOST_REQUIRE( 1 < get_producer_info( N(defproducera) )["unpaid_blocks"].as<uint32_t>() );
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of eosio"), push_action( N(defproducera), N(setpaybatch), mvo()("batch_size", 4) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setpaybatch), mvo()("batch_size", 4) ) );
+   BOOST_REQUIRE_EQUAL( 4, get_global_state4()["autopay_batch_size"].as<uint16_t>() );
+
+   BOOST_REQUIRE( get_producer2_row( N(defproducera) ) );
+
+   produce_block( fc::hours(24) );
+   produce_blocks(250);
+
+   // the schedule update settles the pay, a deferred autopayout sends it
+   auto prod = get_producer_info( N(defproducera) );
+   BOOST_REQUIRE( 0 < get_balance( N(defproducera) ).get_amount() );
+   BOOST_REQUIRE_EQUAL( 0, get_autopay_row( N(defproducera) )->per_block_pay + get_autopay_row( N(defproducera) )->per_vote_pay );
+   BOOST_REQUIRE( 120 > prod["unpaid_blocks"].as<uint32_t>() );
+   BOOST_REQUIRE_EQUAL( "defproducera", get_global_state4()["autopay_cursor"].as_string() );
+   BOOST_REQUIRE_EQUAL( microseconds_since_epoch_of_iso_string( get_global_state()["last_pervote_bucket_fill"] ),
+                        microseconds_since_epoch_of_iso_string( prod["last_claim_time"] ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("already claimed rewards within past day"),
+                        push_action( N(defproducera), N(claimrewards), mvo()("owner", "defproducera") ) );
+
+   // anyone may send accrued pay again
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("automatic payouts are not enabled"),
+                        push_action( N(producvotera), N(autopayout), mvo()("producer", "producvotera") ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no accrued pay"),
+                        push_action( N(producvotera), N(autopayout), mvo()("producer", "defproducera") ) );
+
+   // paid once per day only
+   const auto balance = get_balance( N(defproducera) );
+   produce_blocks(250);
+   BOOST_REQUIRE_EQUAL( balance, get_balance( N(defproducera) ) );
+
+   // opted out producers claim manually again
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(defproducera), N(setautopay), mvo()("producer", "defproducera")("enabled", false) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("automatic payouts are not enabled"),
+                        push_action( N(defproducera), N(setautopay), mvo()("producer", "defproducera")("enabled", false) ) );
+   produce_block( fc::hours(24) );
+   produce_blocks(250);
+   BOOST_REQUIRE_EQUAL( balance, get_balance( N(defproducera) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(defproducera), N(claimrewards), mvo()("owner", "defproducera") ) );
+   BOOST_REQUIRE( balance < get_balance( N(defproducera) ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( producer_bulkclaim, eosio_system_tester, * boost::unit_test::tolerance(1e-10) ) try {
+   const asset large_asset = STRSYM("80.0000");
+   const std::vector<account_name> producers = { N(defproducera), N(defproducerb) };
+   for( const auto& p : producers ) {
+      create_account_with_resources( p, config::system_account_name, STRSYM("1.0000"), false, large_asset, large_asset );
+      BOOST_REQUIRE_EQUAL( success(), regproducer( p ) );
+   }
+   create_account_with_resources( N(producvotera), config::system_account_name, STRSYM("1.0000"), false, large_asset, large_asset );
+   create_account_with_resources( N(producvoterb), config::system_account_name, STRSYM("1.0000"), false, large_asset, large_asset );
+
+   // a voter votes for a single producer, each producer gets its votes from its own voter
+   transfer( config::system_account_name, "producvotera", STRSYM("60000000.0000"), config::system_account_name );
+   transfer( config::system_account_name, "producvoterb", STRSYM("30000000.0000"), config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "producvotera", STRSYM("10.0000"), STRSYM("10.0000"), STRSYM("30000000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "producvoterb", STRSYM("10.0000"), STRSYM("10.0000"), STRSYM("20000000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(producvotera), { N(defproducera) } ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(producvoterb), { N(defproducerb) } ) );
+   produce_blocks(250);
+   produce_block( fc::hours(24) );
+   produce_blocks(50);
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no producers to claim rewards for"), bulkclaim( {} ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("duplicate producer"), bulkclaim( { N(defproducera), N(defproducera) } ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("producer not found"), bulkclaim( { N(defproducera), N(producvotera) } ) );
+
+   const auto initial_global_state = get_global_state();
+   const uint32_t initial_unpaid   = initial_global_state["total_unpaid_blocks"].as<uint32_t>();
+   BOOST_REQUIRE( 0 < get_producer_info( N(defproducera) )["unpaid_blocks"].as<uint32_t>() );
+   BOOST_REQUIRE( 0 < get_producer_info( N(defproducerb) )["unpaid_blocks"].as<uint32_t>() );
+   BOOST_REQUIRE( 0 < initial_unpaid );
+
+   BOOST_REQUIRE_EQUAL( success(), bulkclaim( producers ) );
+
+   const auto global_state = get_global_state();
+   const auto claim_time   = microseconds_since_epoch_of_iso_string( global_state["last_pervote_bucket_fill"] );
+   int64_t paid = 0;
+   uint32_t unpaid_blocks = 0;
+   for( const auto& p : producers ) {
+      const auto prod = get_producer_info( p );
+      BOOST_REQUIRE_EQUAL( claim_time, microseconds_since_epoch_of_iso_string( prod["last_claim_time"] ) );
+      BOOST_REQUIRE( 0 < get_balance( p ).get_amount() );
+      paid          += get_balance( p ).get_amount();
+      unpaid_blocks += prod["unpaid_blocks"].as<uint32_t>();
+   }
+   // blocks produced after the claim transaction
+   BOOST_REQUIRE_EQUAL( unpaid_blocks, global_state["total_unpaid_blocks"].as<uint32_t>() );
+   BOOST_REQUIRE( initial_unpaid > unpaid_blocks );
+
+   // pay accounts keep exactly what is left in the buckets
+   BOOST_REQUIRE_EQUAL( get_balance( N(eosio.bpay) ).get_amount(), global_state["perblock_bucket"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( get_balance( N(eosio.vpay) ).get_amount(), global_state["pervote_bucket"].as<int64_t>() );
+   BOOST_REQUIRE( 0 < paid );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("already claimed rewards within past day"), bulkclaim( producers ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("already claimed rewards within past day"),
+                        push_action( N(defproducerb), N(claimrewards), mvo()("owner", "defproducerb") ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( typed_row_readers, eosio_system_tester ) try {
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(alice1111111) ) );
+   transfer( "eosio", "bob111111111", STRSYM("1000.0000"), "eosio" );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", STRSYM("100.0000"), STRSYM("50.0000"), STRSYM("300.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(alice1111111) } ) );
+   BOOST_REQUIRE_EQUAL( success(), unstake( "bob111111111", STRSYM("10.0000"), STRSYM("5.0000"), STRSYM("30.0000") ) );
+   produce_blocks( 2 );
+
+   // the rows:: mirrors must pack back to exactly the bytes stored by the contracts
+   auto check_layout = [&]( const auto& row, const account_name& code, uint64_t scope, const name& table, uint64_t primary ) {
+      BOOST_REQUIRE( row );
+      const auto stored = get_row_by_account( code, scope, table, primary );
+      BOOST_REQUIRE_EQUAL( true, fc::raw::pack( *row ) == stored );
+   };
+   const auto core = symbol{CORE_SYM}.to_symbol_code().value;
+   check_layout( get_voter_row( N(bob111111111) ), config::system_account_name, config::system_account_name, N(voters), N(bob111111111) );
+   check_layout( get_producer_row( N(alice1111111) ), config::system_account_name, config::system_account_name, N(producers), N(alice1111111) );
+   check_layout( get_producer2_row( N(alice1111111) ), config::system_account_name, config::system_account_name, N(producers2), N(alice1111111) );
+   check_layout( std::make_optional( get_global_row() ), config::system_account_name, config::system_account_name, N(global), N(global) );
+   check_layout( std::make_optional( get_global2_row() ), config::system_account_name, config::system_account_name, N(global2), N(global2) );
+   check_layout( std::make_optional( get_global3_row() ), config::system_account_name, config::system_account_name, N(global3), N(global3) );
+   check_layout( std::make_optional( get_global4_row() ), config::system_account_name, config::system_account_name, N(global4), N(global4) );
+   check_layout( get_user_resources_row( N(bob111111111) ), config::system_account_name, N(bob111111111), N(userres), N(bob111111111) );
+   check_layout( get_refund_row( N(bob111111111) ), config::system_account_name, N(bob111111111), N(refunds), N(bob111111111) );
+   check_layout( get_stats_row( symbol{CORE_SYM} ), N(eosio.token), core, N(stat), core );
+   if( get_election_cache_row() ) {
+      check_layout( get_election_cache_row(), config::system_account_name, config::system_account_name, N(electcache), N(electcache) );
+   }
+
+   // and agree with the ABI decoding
+   const auto row = *get_voter_row( N(bob111111111) );
+   BOOST_REQUIRE_EQUAL( N(bob111111111), row.owner );
+   REQUIRE_MATCHING_OBJECT( voter( row.owner, row.staked )( "producers", row.producers ), get_voter_info( N(bob111111111) ) );
+   BOOST_REQUIRE_EQUAL( STRSYM("30.0000").get_amount(), get_refund_row( N(bob111111111) )->vote_amount.get_amount() );
+   BOOST_REQUIRE_EQUAL( get_global_state()["total_activated_stake"].as<int64_t>(), get_global_row().total_activated_stake );
+   BOOST_REQUIRE_EQUAL( get_producer_info( N(alice1111111) )["total_votes"].as_double(), get_producer_row( N(alice1111111) )->total_votes );
+   BOOST_REQUIRE_EQUAL( get_stats( "4," CORE_SYM_NAME )["supply"].as<asset>(), get_token_supply() );
+   BOOST_REQUIRE( !get_voter_row( N(carol1111111) ) || get_voter_row( N(carol1111111) )->producers.empty() );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( vote_epoch_rescale, eosio_system_tester ) try {
+   create_accounts_with_resources( { N(dan111111111) } );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(alice1111111) ) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(dan111111111) ) );
+   for( const auto& v : { N(bob111111111), N(carol1111111), N(dan111111111) } ) {
+      transfer( "eosio", v, STRSYM("1000.0000"), "eosio" );
+   }
+   for( const auto& v : { N(bob111111111), N(carol1111111) } ) {
+      BOOST_REQUIRE_EQUAL( success(), stake( v, STRSYM("100.0000"), STRSYM("50.0000"), STRSYM("300.0000") ) );
+      BOOST_REQUIRE_EQUAL( success(), vote( v, { N(alice1111111) } ) );
+   }
+   BOOST_REQUIRE_EQUAL( success(), stake( N(dan111111111), STRSYM("100.0000"), STRSYM("50.0000"), STRSYM("100.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(dan111111111), { N(dan111111111) } ) );
+   produce_blocks( 2 );
+
+   const auto total_weight   = get_global_row().total_producer_vote_weight;
+   const auto epsilon        = get_global4_row().vote_propagation_epsilon;
+   const auto dan_votes      = get_producer_row( N(dan111111111) )->total_votes;
+   const auto votepay_share  = get_producer2_row( N(dan111111111) )->votepay_share;
+   const auto votepay_offset = votepay_share_offset( N(dan111111111) );
+   const auto alice_votes    = get_producer_row( N(alice1111111) )->total_votes;
+   const auto bob_weight     = get_voter_row( N(bob111111111) )->last_vote_weight;
+   BOOST_REQUIRE_EQUAL( 0, get_global4_row().vote_epoch );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("max_rows must be positive"),
+                        push_action( N(bob111111111), N(rescalevote), mvo()("max_rows", 0) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(bob111111111), N(rescalevote), mvo()("max_rows", 1) ) );
+
+   // totals and the epsilon move to the new epoch at once, exactly since the scale is a power of two
+   const auto global4 = get_global4_row();
+   BOOST_REQUIRE( 0 < global4.vote_epoch );
+   BOOST_REQUIRE( global4.vote_sweep_pending );
+   const double scale = std::ldexp( 1.0, -int(global4.vote_epoch) );
+   BOOST_REQUIRE_EQUAL( total_weight * scale, get_global_row().total_producer_vote_weight );
+   BOOST_REQUIRE_EQUAL( epsilon * scale, global4.vote_propagation_epsilon );
+
+   // producers follow one row per call, no producer has a key of zero or above, so the lowest ranked active one is first
+   BOOST_REQUIRE_EQUAL( 2, global4.producer_sweep_phase );
+   BOOST_REQUIRE_EQUAL( N(dan111111111), global4.producer_sweep_cursor );
+   BOOST_REQUIRE_EQUAL( dan_votes * scale, get_producer_row( N(dan111111111) )->total_votes );
+   BOOST_REQUIRE_EQUAL( votepay_share * scale, get_producer2_row( N(dan111111111) )->votepay_share );
+   BOOST_REQUIRE_EQUAL( votepay_offset * scale, votepay_share_offset( N(dan111111111) ) );
+   BOOST_REQUIRE_EQUAL( alice_votes, get_producer_row( N(alice1111111) )->total_votes );
+
+   // votes for a producer the sweep did not reach are applied in its epoch, voters of the old epoch are converted
+   // when they are touched
+   BOOST_REQUIRE_EQUAL( 0, get_voter_row( N(carol1111111) )->vote_epoch );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { } ) );
+   BOOST_REQUIRE_EQUAL( global4.vote_epoch, get_voter_row( N(carol1111111) )->vote_epoch );
+   BOOST_REQUIRE( std::abs( get_producer_row( N(alice1111111) )->total_votes - bob_weight ) < 1e-3 );
+
+   // the rest of both sweeps runs in bounded batches
+   while( get_global4_row().vote_sweep_pending || get_global4_row().producer_sweep_phase != 0 ) {
+      BOOST_REQUIRE_EQUAL( success(), push_action( N(bob111111111), N(rescalevote), mvo()("max_rows", 2) ) );
+      produce_block();
+   }
+   BOOST_REQUIRE_EQUAL( 1, get_global4_row().producer_sweep_scale );
+   BOOST_REQUIRE( std::abs( get_producer_row( N(alice1111111) )->total_votes - bob_weight * scale ) < 1e-3 );
+   BOOST_REQUIRE( get_producer_row( N(alice1111111) )->total_votes < 2 * STRSYM("300.0000").get_amount() );
+   BOOST_REQUIRE_EQUAL( dan_votes * scale, get_producer_row( N(dan111111111) )->total_votes );
+   BOOST_REQUIRE_EQUAL( global4.vote_epoch, get_voter_row( N(bob111111111) )->vote_epoch );
+   BOOST_REQUIRE_EQUAL( bob_weight * scale, get_voter_row( N(bob111111111) )->last_vote_weight );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("action has no effect"),
+                        push_action( N(bob111111111), N(rescalevote), mvo()("max_rows", 1) ) );
+
+   // and withdraw exactly what they cast in the old epoch
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { } ) );
+   BOOST_REQUIRE( std::abs( get_producer_row( N(alice1111111) )->total_votes ) < 1e-3 );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(dan111111111), { } ) );
+   BOOST_REQUIRE( std::abs( get_global_row().total_producer_vote_weight ) < 1e-3 );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( votepay_accrues_through_offset, eosio_system_tester, * boost::unit_test::tolerance(1e-10) ) try {
+   cross_15_percent_threshold();
+
+   const std::vector<account_name> accounts = { N(aliceaccount), N(bobbyaccount), N(carolaccount) };
+   for( const auto& a : accounts ) {
+      create_account_with_resources( a, config::system_account_name, STRSYM("1.0000"), false, STRSYM("80.0000"), STRSYM("80.0000") );
+      transfer( config::system_account_name, a, STRSYM("1000.0000"), config::system_account_name );
+   }
+   const auto vota = accounts[0];
+   const auto votb = accounts[1];
+   const auto prod = accounts[2];
+   BOOST_REQUIRE_EQUAL( success(), regproducer( prod ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( vota, STRSYM("10.0000"), STRSYM("10.0000"), STRSYM("100.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( votb, STRSYM("10.0000"), STRSYM("10.0000"), STRSYM("300.0000") ) );
+   const auto settled = get_producer_info2( prod );
+   const auto t0      = microseconds_since_epoch_of_iso_string( settled["last_votepay_share_update"] );
+
+   // vote changes inside the window leave producers2 alone and accrue through the votepay offset of the producer
+   auto vote_at = [&]( const account_name& voter ) {
+      produce_block( fc::hours(5) );
+      BOOST_REQUIRE_EQUAL( success(), vote( voter, { prod } ) );
+      const auto info2 = get_producer_info2( prod );
+      BOOST_REQUIRE_EQUAL( settled["last_votepay_share_update"].as_string(), info2["last_votepay_share_update"].as_string() );
+      BOOST_TEST_REQUIRE( settled["votepay_share"].as_double() == info2["votepay_share"].as_double() );
+      return std::make_pair( microseconds_since_epoch_of_iso_string( get_global_state3()["last_vpay_state_update"] ),
+                             get_producer_info( prod )["total_votes"].as_double() );
+   };
+   const auto a = vote_at( vota );
+   const auto b = vote_at( votb );
+   BOOST_REQUIRE( 0 < votepay_share_offset( prod ) );
+   // the offset of votes cast by others is billed to the contract, the producer row keeps its size and payer
+   BOOST_REQUIRE_EQUAL( config::system_account_name,
+                        *row_payer( config::system_account_name, config::system_account_name, N(votepayoff), prod ) );
+   BOOST_REQUIRE_EQUAL( prod, *row_payer( config::system_account_name, config::system_account_name, N(producers), prod ) );
+
+   // at any later time the row yields the share accrued at the votes held in each period
+   const auto   info    = get_producer_info( prod );
+   const auto   later   = b.first + 3600 * 1000000ull;
+   const double accrued = ( a.second * ( b.first - a.first ) + b.second * ( later - b.first ) ) / 1E6;
+   const double on_row  = settled["votepay_share"].as_double() + info["total_votes"].as_double() * ( later - t0 ) / 1E6
+                          - votepay_share_offset( prod );
+   BOOST_TEST_REQUIRE( accrued == on_row );
+
+   produce_block( fc::hours(20) );
+   // claims settle producers2 and reset the offset
+   BOOST_REQUIRE_EQUAL( success(), push_action( prod, N(claimrewards), mvo()("owner", prod) ) );
+   BOOST_TEST_REQUIRE( 0 == get_producer_info2( prod )["votepay_share"].as_double() );
+   BOOST_TEST_REQUIRE( 0 == votepay_share_offset( prod ) );
+   BOOST_REQUIRE( !row_payer( config::system_account_name, config::system_account_name, N(votepayoff), prod ) );
+   BOOST_REQUIRE_EQUAL( get_producer_info( prod )["last_claim_time"].as_string(),
+                        get_producer_info2( prod )["last_votepay_share_update"].as_string() );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( stale_votes_expire, eosio_system_tester ) try {
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(alice1111111) ) );
+   for( const auto& v : { N(bob111111111), N(carol1111111) } ) {
+      transfer( "eosio", v, STRSYM("1000.0000"), "eosio" );
+      BOOST_REQUIRE_EQUAL( success(), stake( v, STRSYM("100.0000"), STRSYM("50.0000"), STRSYM("300.0000") ) );
+      BOOST_REQUIRE_EQUAL( success(), vote( v, { N(alice1111111) } ) );
+   }
+   auto has_activity = [&]( const account_name& v ) {
+      return !get_row_by_account( config::system_account_name, config::system_account_name, N(voteact), v ).empty();
+   };
+   BOOST_REQUIRE( has_activity( N(bob111111111) ) && has_activity( N(carol1111111) ) );
+   BOOST_REQUIRE_EQUAL( config::system_account_name,
+                        *row_payer( config::system_account_name, config::system_account_name, N(voteact), N(bob111111111) ) );
+
+   // a contract initialized before any stake has no earlier votes to index
+   BOOST_REQUIRE( get_global4_row().vote_activity_complete );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("action has no effect"),
+                        push_action( N(bob111111111), N(indexvoteact), mvo()("max_rows", 10) ) );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("vote expiry is disabled"),
+                        push_action( N(bob111111111), N(expirevotes), mvo()("max_rows", 10) ) );
+   BOOST_REQUIRE_EQUAL( error("missing authority of eosio"),
+                        push_action( N(bob111111111), N(setvoteexp), mvo()("expiry_time", 30 * 24 * 3600) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setvoteexp), mvo()("expiry_time", 30 * 24 * 3600) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("action has no effect"),
+                        push_action( N(bob111111111), N(expirevotes), mvo()("max_rows", 10) ) );
+
+   produce_block( fc::days(20) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(alice1111111) } ) );
+   produce_block( fc::days(15) );
+
+   // only bob did not vote within 30 days
+   const auto active_stake = get_global_row().active_stake;
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(carol1111111), N(expirevotes), mvo()("max_rows", 10) ) );
+   BOOST_REQUIRE( !has_activity( N(bob111111111) ) );
+   BOOST_REQUIRE( has_activity( N(carol1111111) ) );
+   BOOST_REQUIRE( get_voter_row( N(bob111111111) )->producers.empty() );
+   BOOST_REQUIRE_EQUAL( active_stake - get_voter_row( N(bob111111111) )->staked, get_global_row().active_stake );
+   BOOST_REQUIRE( std::abs( get_voter_row( N(carol1111111) )->last_vote_weight - get_producer_row( N(alice1111111) )->total_votes ) < 1e-3 );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("action has no effect"),
+                        push_action( N(carol1111111), N(expirevotes), mvo()("max_rows", 10) ) );
+
+   // voting again starts over
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(alice1111111) } ) );
+   BOOST_REQUIRE( has_activity( N(bob111111111) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { } ) );
+   BOOST_REQUIRE( !has_activity( N(bob111111111) ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( proxy_follower_index, eosio_system_tester ) try {
+   create_accounts_with_resources( { N(dan111111111) } );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(alice1111111) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(bob111111111), N(regproxy), mvo()("proxy", "bob111111111")("isproxy", true) ) );
+   for( const auto& v : { N(carol1111111), N(dan111111111) } ) {
+      transfer( "eosio", v, STRSYM("1000.0000"), "eosio" );
+      BOOST_REQUIRE_EQUAL( success(), stake( v, STRSYM("100.0000"), STRSYM("50.0000"), STRSYM("300.0000") ) );
+      BOOST_REQUIRE_EQUAL( success(), vote( v, { }, N(bob111111111) ) );
+   }
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(alice1111111) } ) );
+
+   // a contract initialized before any stake starts with a complete index
+   BOOST_REQUIRE( get_global4_row().proxy_index_complete );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("action has no effect"),
+                        push_action( N(carol1111111), N(indexproxies), mvo()("max_rows", 10) ) );
+
+   const int64_t staked = get_voter_row( N(carol1111111) )->staked;
+   BOOST_REQUIRE_EQUAL( staked, get_proxy_follower_row( N(bob111111111), N(carol1111111) )->staked );
+   BOOST_REQUIRE_EQUAL( config::system_account_name,
+                        *row_payer( config::system_account_name, N(bob111111111), N(proxyfollow), N(carol1111111) ) );
+   BOOST_REQUIRE_EQUAL( 2u, get_proxy_stats_row( N(bob111111111) )->followers );
+   BOOST_REQUIRE_EQUAL( 2 * staked, get_proxy_stats_row( N(bob111111111) )->staked );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("account is not a proxy"),
+                        push_action( N(carol1111111), N(rebuildproxy), mvo()("proxy", "carol1111111")("max_rows", 1) ) );
+
+   // carol is summed up by the first call, her stake change is added to the partial sum
+   const double proxied = get_voter_row( N(bob111111111) )->proxied_vote_weight;
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(carol1111111), N(rebuildproxy), mvo()("proxy", "bob111111111")("max_rows", 1) ) );
+   BOOST_REQUIRE( get_proxy_stats_row( N(bob111111111) )->rebuilding );
+   BOOST_REQUIRE_EQUAL( N(carol1111111), get_proxy_stats_row( N(bob111111111) )->rebuild_cursor );
+   BOOST_REQUIRE_EQUAL( success(), stake( N(carol1111111), STRSYM("0.0000"), STRSYM("0.0000"), STRSYM("100.0000") ) );
+   BOOST_REQUIRE_EQUAL( 2 * staked + 1000000, get_proxy_stats_row( N(bob111111111) )->staked );
+   const double expected = get_voter_row( N(carol1111111) )->last_vote_weight + get_voter_row( N(dan111111111) )->last_vote_weight;
+   BOOST_REQUIRE( expected > proxied );
+
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(carol1111111), N(rebuildproxy), mvo()("proxy", "bob111111111")("max_rows", 1) ) );
+   BOOST_REQUIRE( !get_proxy_stats_row( N(bob111111111) )->rebuilding );
+   BOOST_REQUIRE( std::abs( expected - get_voter_row( N(bob111111111) )->proxied_vote_weight ) < 1e-3 );
+   BOOST_REQUIRE( std::abs( get_voter_row( N(bob111111111) )->last_vote_weight - get_producer_row( N(alice1111111) )->total_votes ) < 1e-3 );
+
+   // leaving the proxy removes the follower, the aggregates go with the last one
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(alice1111111) } ) );
+   BOOST_REQUIRE( !get_proxy_follower_row( N(bob111111111), N(carol1111111) ) );
+   BOOST_REQUIRE_EQUAL( 1u, get_proxy_stats_row( N(bob111111111) )->followers );
+   BOOST_REQUIRE_EQUAL( staked, get_proxy_stats_row( N(bob111111111) )->staked );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(dan111111111), { } ) );
+   BOOST_REQUIRE( !get_proxy_stats_row( N(bob111111111) ) );
+
+   // a rebuild of a proxy without followers does not create aggregates
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(carol1111111), N(rebuildproxy), mvo()("proxy", "bob111111111")("max_rows", 1) ) );
+   BOOST_REQUIRE( !get_proxy_stats_row( N(bob111111111) ) );
+   BOOST_REQUIRE_EQUAL( 0.0, get_voter_row( N(bob111111111) )->proxied_vote_weight );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( pending_votes_flush_on_schedule_update, eosio_system_tester ) try {
+   cross_15_percent_threshold();
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(alice1111111) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(bob111111111), N(regproxy), mvo()("proxy", "bob111111111")("isproxy", true) ) );
+   for( const auto& v : { N(bob111111111), N(carol1111111) } ) {
+      transfer( "eosio", v, STRSYM("1000.0000"), "eosio" );
+      BOOST_REQUIRE_EQUAL( success(), stake( v, STRSYM("100.0000"), STRSYM("50.0000"), STRSYM("300.0000") ) );
+   }
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { }, N(bob111111111) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(alice1111111) } ) );
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of eosio"),
+                        push_action( N(bob111111111), N(setvoteprop), mvo()("epsilon", 1e30)("flush_batch_size", 0) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("epsilon must not be negative"),
+                        push_action( config::system_account_name, N(setvoteprop), mvo()("epsilon", -1.)("flush_batch_size", 0) ) );
+   BOOST_REQUIRE_EQUAL( success(),
+                        push_action( config::system_account_name, N(setvoteprop), mvo()("epsilon", 1e30)("flush_batch_size", 0) ) );
+
+   auto is_pending = [&]( const account_name& v ) {
+      return !get_row_by_account( config::system_account_name, config::system_account_name, N(votepending), v ).empty();
+   };
+
+   // the proxied weight of bob grows, the change is held back from alice
+   const double alice_votes = get_producer_row( N(alice1111111) )->total_votes;
+   BOOST_REQUIRE_EQUAL( success(), stake( N(carol1111111), STRSYM("0.0000"), STRSYM("0.0000"), STRSYM("100.0000") ) );
+   BOOST_REQUIRE( is_pending( N(bob111111111) ) );
+   BOOST_REQUIRE_EQUAL( alice_votes, get_producer_row( N(alice1111111) )->total_votes );
+   BOOST_REQUIRE_EQUAL( alice_votes, get_voter_row( N(bob111111111) )->last_vote_weight );
+   produce_block( fc::minutes(2) );
+   produce_blocks( 2 );
+   BOOST_REQUIRE( is_pending( N(bob111111111) ) );
+
+   // and passed on by the next schedule update once flushing is enabled
+   BOOST_REQUIRE_EQUAL( success(),
+                        push_action( config::system_account_name, N(setvoteprop), mvo()("epsilon", 1e30)("flush_batch_size", 10) ) );
+   produce_block( fc::minutes(2) );
+   produce_blocks( 2 );
+   BOOST_REQUIRE( !is_pending( N(bob111111111) ) );
+   const auto bob = *get_voter_row( N(bob111111111) );
+   BOOST_REQUIRE( bob.last_vote_weight > alice_votes );
+   BOOST_REQUIRE( std::abs( bob.last_vote_weight - get_producer_row( N(alice1111111) )->total_votes ) < 1e-3 );
+
+   // a new vote passes the whole weight on at once
+   BOOST_REQUIRE_EQUAL( success(),
+                        push_action( config::system_account_name, N(setvoteprop), mvo()("epsilon", 1e30)("flush_batch_size", 0) ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( N(carol1111111), STRSYM("0.0000"), STRSYM("0.0000"), STRSYM("100.0000") ) );
+   BOOST_REQUIRE( is_pending( N(bob111111111) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(alice1111111) } ) );
+   BOOST_REQUIRE( !is_pending( N(bob111111111) ) );
+   BOOST_REQUIRE( std::abs( get_voter_row( N(bob111111111) )->last_vote_weight - get_producer_row( N(alice1111111) )->total_votes ) < 1e-3 );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( election_preview_published, eosio_system_tester ) try {
+   cross_15_percent_threshold();
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(alice1111111) ) );
+   for( const auto& v : { N(bob111111111), N(carol1111111) } ) {
+      transfer( "eosio", v, STRSYM("1000.0000"), "eosio" );
+      BOOST_REQUIRE_EQUAL( success(), stake( v, STRSYM("100.0000"), STRSYM("50.0000"), STRSYM("300.0000") ) );
+   }
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(alice1111111) } ) );
+   produce_block( fc::minutes(2) );
+   produce_blocks( 2 );
+
+   auto preview = get_election_preview_row();
+   BOOST_REQUIRE( preview );
+   BOOST_REQUIRE_EQUAL( 1u, preview->producers.size() );
+   BOOST_REQUIRE_EQUAL( N(alice1111111), preview->producers[0] );
+   BOOST_REQUIRE_EQUAL( get_global_row().target_producer_schedule_size, preview->target_schedule_size );
+   BOOST_REQUIRE_EQUAL( get_global4_row().vote_epoch, preview->vote_epoch );
+   BOOST_REQUIRE_EQUAL( get_producer_row( N(alice1111111) )->total_votes, preview->cutoff_votes );
+
+   // an unchanged election does not rewrite the row
+   const auto last_change = preview->last_change;
+   produce_block( fc::minutes(2) );
+   produce_blocks( 2 );
+   BOOST_REQUIRE( last_change == get_election_preview_row()->last_change );
+
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(alice1111111) } ) );
+   produce_block( fc::minutes(2) );
+   produce_blocks( 2 );
+   preview = get_election_preview_row();
+   BOOST_REQUIRE( last_change < preview->last_change );
+   BOOST_REQUIRE_EQUAL( get_producer_row( N(alice1111111) )->total_votes, preview->cutoff_votes );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( schedule_size_strategies, eosio_system_tester ) try {
+   auto setschedsize = [&]( const account_name& signer, uint8_t strategy, uint16_t step, uint16_t band, uint8_t gain ) {
+      return push_action( signer, N(setschedsize), mvo()("strategy", strategy)("step", step)("band", band)("gain", gain) );
+   };
+   BOOST_REQUIRE_EQUAL( error("missing authority of eosio"), setschedsize( N(alice1111111), 1, 3, 30, 50 ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("unknown schedule size strategy"), setschedsize( config::system_account_name, 3, 3, 30, 50 ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("step must be positive"), setschedsize( config::system_account_name, 0, 0, 30, 50 ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("gain must not exceed 100 percent"), setschedsize( config::system_account_name, 2, 3, 30, 101 ) );
+   BOOST_REQUIRE_EQUAL( success(), setschedsize( config::system_account_name, 1, 3, 30, 50 ) );
+
+   // about 41% of the supply voting moves the target amount to 45 producers
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(alice1111111) ) );
+   transfer( "eosio", "bob111111111", STRSYM("70000000.0000"), "eosio" );
+   BOOST_REQUIRE_EQUAL( success(), stake( N(bob111111111), STRSYM("0.0000"), STRSYM("0.0000"), STRSYM("70000000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(alice1111111) } ) );
+   BOOST_REQUIRE_EQUAL( 21, get_global_row().target_producer_schedule_size );
+
+   // 24 producers away is within the band of 30
+   produce_block( fc::minutes(2) );
+   produce_blocks( 2 );
+   const auto first_update = get_global_row().last_target_schedule_size_update;
+   BOOST_REQUIRE( block_timestamp_type() < first_update );
+   BOOST_REQUIRE_EQUAL( 21, get_global_row().target_producer_schedule_size );
+
+   // not due again before 2 * schedule_update_interval slots
+   BOOST_REQUIRE_EQUAL( success(), setschedsize( config::system_account_name, 2, 3, 30, 50 ) );
+   produce_block( fc::hours(12) );
+   produce_blocks( 2 );
+   BOOST_REQUIRE( first_update == get_global_row().last_target_schedule_size_update );
+   BOOST_REQUIRE_EQUAL( 21, get_global_row().target_producer_schedule_size );
+
+   // half of the distance
+   produce_block( fc::hours(12) );
+   produce_blocks( 2 );
+   BOOST_REQUIRE_EQUAL( 33, get_global_row().target_producer_schedule_size );
+
+   // a fixed step
+   BOOST_REQUIRE_EQUAL( success(), setschedsize( config::system_account_name, 0, 3, 0, 50 ) );
+   produce_block( fc::days(1) );
+   produce_blocks( 2 );
+   BOOST_REQUIRE_EQUAL( 36, get_global_row().target_producer_schedule_size );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( maintenance_tasks_run_in_onblock, eosio_system_tester ) try {
+   cross_15_percent_threshold();
+   auto settask = [&]( const account_name& signer, const account_name& task, uint32_t interval, uint16_t batch_size ) {
+      return push_action( signer, N(settask), mvo()("task", task)("interval", interval)("batch_size", batch_size) );
+   };
+   BOOST_REQUIRE_EQUAL( error("missing authority of eosio"), settask( N(alice1111111), N(flushvotes), 20, 5 ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("unknown maintenance task"), settask( config::system_account_name, N(refund), 20, 5 ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("batch_size must be positive"), settask( config::system_account_name, N(flushvotes), 20, 0 ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("task is not scheduled"), settask( config::system_account_name, N(flushvotes), 0, 0 ) );
+
+   // votes held back by the proxy are only flushed by the task
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(alice1111111) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(bob111111111), N(regproxy), mvo()("proxy", "bob111111111")("isproxy", true) ) );
+   for( const auto& v : { N(bob111111111), N(carol1111111) } ) {
+      transfer( "eosio", v, STRSYM("1000.0000"), "eosio" );
+      BOOST_REQUIRE_EQUAL( success(), stake( v, STRSYM("100.0000"), STRSYM("50.0000"), STRSYM("300.0000") ) );
+   }
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { }, N(bob111111111) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(alice1111111) } ) );
+   BOOST_REQUIRE_EQUAL( success(),
+                        push_action( config::system_account_name, N(setvoteprop), mvo()("epsilon", 1e30)("flush_batch_size", 0) ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( N(carol1111111), STRSYM("0.0000"), STRSYM("0.0000"), STRSYM("100.0000") ) );
+   auto is_pending = [&]( const account_name& v ) {
+      return !get_row_by_account( config::system_account_name, config::system_account_name, N(votepending), v ).empty();
+   };
+   BOOST_REQUIRE( is_pending( N(bob111111111) ) );
+
+   // a zero budget disables the scheduler
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setmaintbudg), mvo()("budget", 0) ) );
+   BOOST_REQUIRE_EQUAL( success(), settask( config::system_account_name, N(flushvotes), 20, 5 ) );
+   produce_blocks( 2 );
+   BOOST_REQUIRE( is_pending( N(bob111111111) ) );
+
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setmaintbudg), mvo()("budget", 10) ) );
+   produce_blocks( 2 );
+   BOOST_REQUIRE( !is_pending( N(bob111111111) ) );
+   BOOST_REQUIRE( std::abs( get_voter_row( N(bob111111111) )->last_vote_weight - get_producer_row( N(alice1111111) )->total_votes ) < 1e-3 );
+
+   const auto task = *get_maintenance_task_row( N(flushvotes) );
+   BOOST_REQUIRE_EQUAL( N(flushvotes), get_global4_row().maintenance_cursor );
+   BOOST_REQUIRE_EQUAL( task.next_slot, get_global4_row().next_maintenance_slot );
+   BOOST_REQUIRE( control->head_block_state()->header.timestamp.slot < task.next_slot );
+
+   BOOST_REQUIRE_EQUAL( success(), settask( config::system_account_name, N(flushvotes), 0, 0 ) );
+   BOOST_REQUIRE( !get_maintenance_task_row( N(flushvotes) ) );
+   BOOST_REQUIRE_EQUAL( std::numeric_limits<uint32_t>::max(), get_global4_row().next_maintenance_slot );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( emission_streamed_by_maintenance_task, eosio_system_tester ) try {
+   cross_15_percent_threshold();
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(alice1111111) ) );
+   produce_blocks( 2 );
+   BOOST_REQUIRE( !get_global4_row().emission_streaming );
+
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(settask),
+                                                mvo()("task", "emission")("interval", 20)("batch_size", 1) ) );
+   BOOST_REQUIRE( get_global4_row().emission_streaming );
+
+   // every run issues the emission of its interval and funds the buckets
+   const auto supply = get_token_supply();
+   const auto vpay   = get_balance( N(eosio.vpay) );
+   produce_blocks( 45 );
+   BOOST_REQUIRE( supply < get_token_supply() );
+   BOOST_REQUIRE( vpay < get_balance( N(eosio.vpay) ) );
+   const auto global = get_global_row();
+   BOOST_REQUIRE_EQUAL( global.pervote_bucket, get_balance( N(eosio.vpay) ).get_amount() );
+   BOOST_REQUIRE( control->head_block_time() - global.last_pervote_bucket_fill <= fc::seconds(10) );
+
+   // claims only settle against the streamed buckets
+   const auto before_claim = get_token_supply();
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(claimrewards), mvo()("owner", "alice1111111") ) );
+   BOOST_REQUIRE_EQUAL( before_claim, get_token_supply() );
+
+   // without a maintenance budget the task never runs, so claims fill the buckets again
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setmaintbudg), mvo()("budget", 0) ) );
+   BOOST_REQUIRE( !get_global4_row().emission_streaming );
+   produce_block( fc::days(1) );
+   produce_blocks( 2 );
+   const auto unstreamed = get_token_supply();
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(claimrewards), mvo()("owner", "alice1111111") ) );
+   BOOST_REQUIRE( unstreamed < get_token_supply() );
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setmaintbudg), mvo()("budget", 100) ) );
+   BOOST_REQUIRE( get_global4_row().emission_streaming );
+
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(settask),
+                                                mvo()("task", "emission")("interval", 0)("batch_size", 0) ) );
+   BOOST_REQUIRE( !get_global4_row().emission_streaming );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( emission_stream_stops_at_max_supply, eosio_system_tester ) try {
+   cross_15_percent_threshold();
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(alice1111111) ) );
+   BOOST_REQUIRE_EQUAL( error("missing authority of eosio"), push_action( N(alice1111111), N(fillbuckets), mvo() ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(settask),
+                                                mvo()("task", "emission")("interval", 20)("batch_size", 1) ) );
+   produce_blocks( 45 );
+
+   // leave less than the emission of a single run
+   const auto max_supply = get_stats_row( symbol{CORE_SYM} )->max_supply;
+   issue( config::system_account_name, max_supply - get_token_supply() - STRSYM("1.0000") );
+   produce_blocks( 45 );
+   BOOST_REQUIRE_EQUAL( max_supply, get_token_supply() );
+   auto global = get_global_row();
+   BOOST_REQUIRE_EQUAL( global.pervote_bucket, get_balance( N(eosio.vpay) ).get_amount() );
+
+   // onblock keeps updating the schedule while the stream has nothing left to issue
+   const auto bucket_fill = global.last_pervote_bucket_fill;
+   const auto last_update = global.last_producer_schedule_update;
+   produce_blocks( 250 );
+   global = get_global_row();
+   BOOST_REQUIRE( last_update < global.last_producer_schedule_update );
+   BOOST_REQUIRE( bucket_fill == global.last_pervote_bucket_fill );
+   BOOST_REQUIRE_EQUAL( max_supply, get_token_supply() );
+
+   // and claims settle against the filled buckets
+   produce_block( fc::days(1) );
+   produce_blocks( 2 );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(claimrewards), mvo()("owner", "alice1111111") ) );
+   BOOST_REQUIRE_EQUAL( max_supply, get_token_supply() );
+} FC_LOG_AND_RETHROW()
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,263 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosio/chain/abi_serializer.hpp>
+#include <eosio/chain/account_object.hpp>
+#include <eosio/chain/config.hpp>
+#include <eosio/chain/contract_table_objects.hpp>
+#include <eosio/chain/controller.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace eosio_system {
+
+using namespace eosio::chain;
+
+/**
+ *  RAM footprint of the contract tables of a chain, as billed to the payers of the rows.
+ *
+ *  Every row is billed its serialized size plus the fixed overhead of a key_value_object, every secondary
+ *  index entry the overhead of its index object and every table the overhead of a table_id_object.
+ *  Rows are decoded with the ABI of their contract to attribute serialized bytes to the fields of the row
+ *  struct: fields named reserved* and fields holding their default value in every row are reported as
+ *  compaction candidates.
+ */
+class ram_footprint_report {
+public:
+   struct field_usage {
+      uint64_t bytes = 0;
+      uint64_t default_rows = 0; // rows holding 0, "", false or an empty array in this field
+   };
+
+   struct table_usage {
+      uint32_t                           tables = 0; // scopes
+      vector<uint32_t>                   row_sizes;
+      uint64_t                           secondary_entries = 0;
+      uint64_t                           billed = 0;
+      std::string                        type;
+      vector<std::string>                field_order;
+      std::map<std::string, field_usage> fields;
+
+      uint64_t value_bytes()const {
+         uint64_t total = 0;
+         for( auto s : row_sizes ) total += s;
+         return total;
+      }
+
+      /// bytes in reserved* fields and in fields that are at their default in every row
+      uint64_t compactable_bytes()const {
+         uint64_t total = 0;
+         for( const auto& f : fields ) {
+            if( is_compactable( f.first, f.second ) )
+               total += f.second.bytes;
+         }
+         return total;
+      }
+
+      bool is_compactable( const std::string& field, const field_usage& u )const {
+         return field.find( "reserved" ) == 0 || ( !row_sizes.empty() && u.default_rows == row_sizes.size() );
+      }
+   };
+
+   struct payer_usage {
+      uint64_t rows = 0;
+      uint64_t billed = 0;
+   };
+
+   void collect( const controller& control, const vector<account_name>& codes, const fc::microseconds& max_time ) {
+      const auto& db     = control.db();
+      const auto& tables = db.get_index<table_id_multi_index, by_code_scope_table>();
+      const auto& rows   = db.get_index<key_value_index, by_scope_primary>();
+
+      for( const auto& code : codes ) {
+         abi_def abi;
+         abi_serializer ser;
+         const bool has_abi = abi_serializer::to_abi( db.get<account_object, by_name>( code ).abi, abi );
+         if( has_abi ) {
+            ser.set_abi( abi, max_time );
+         }
+
+         for( auto t = tables.lower_bound( boost::make_tuple( code ) ); t != tables.end() && t->code == code; ++t ) {
+            auto& usage = usages[ { code, t->table } ];
+            ++usage.tables;
+            usage.billed += config::billable_size_v<table_id_object>;
+            payers[t->payer].billed += config::billable_size_v<table_id_object>;
+            if( usage.type.empty() && has_abi ) {
+               const auto type = ser.resolve_type( ser.get_table_type( t->table ) );
+               if( ser.is_struct( type ) ) {
+                  usage.type        = type;
+                  usage.field_order = struct_fields( ser, type );
+               }
+            }
+
+            for( auto r = rows.lower_bound( boost::make_tuple( t->id ) ); r != rows.end() && r->t_id == t->id; ++r ) {
+               const uint64_t billed = r->value.size() + config::billable_size_v<key_value_object>;
+               usage.row_sizes.push_back( r->value.size() );
+               usage.billed += billed;
+               auto& p = payers[r->payer];
+               ++p.rows;
+               p.billed += billed;
+               if( !usage.type.empty() ) {
+                  add_fields( ser, usage, r->value, max_time );
+               }
+            }
+
+            count_secondary<index64_index>( db, *t, usage );
+            count_secondary<index128_index>( db, *t, usage );
+            count_secondary<index256_index>( db, *t, usage );
+            count_secondary<index_double_index>( db, *t, usage );
+            count_secondary<index_long_double_index>( db, *t, usage );
+         }
+      }
+   }
+
+   void print( std::ostream& out, size_t top_payers = 20 )const {
+      char line[200];
+      std::snprintf( line, sizeof(line), "%-26s %7s %8s %6s %6s %6s %6s %10s %10s %10s\n",
+                     "table", "scopes", "rows", "min", "p50", "p90", "max", "row_bytes", "billed", "compact" );
+      out << line;
+      for( const auto& u : usages ) {
+         const auto& t = u.second;
+         auto s = t.row_sizes;
+         std::sort( s.begin(), s.end() );
+         auto pct = [&]( double p ) { return s.empty() ? 0u : s[ std::min<size_t>( s.size() - 1, size_t( p * s.size() ) ) ]; };
+         std::snprintf( line, sizeof(line), "%-26s %7u %8zu %6u %6u %6u %6u %10llu %10llu %10llu\n",
+                        ( u.first.first.to_string() + "::" + u.first.second.to_string() ).c_str(), t.tables, s.size(),
+                        s.empty() ? 0u : s.front(), pct( 0.5 ), pct( 0.9 ), s.empty() ? 0u : s.back(),
+                        (unsigned long long)t.value_bytes(), (unsigned long long)t.billed,
+                        (unsigned long long)t.compactable_bytes() );
+         out << line;
+         for( const auto& name : t.field_order ) {
+            auto itr = t.fields.find( name );
+            if( itr == t.fields.end() )
+               continue;
+            const auto& f = itr->second;
+            std::snprintf( line, sizeof(line), "   %-23s %10llu bytes %6.1f%% default%s\n", name.c_str(),
+                           (unsigned long long)f.bytes, s.empty() ? 0.0 : 100.0 * f.default_rows / s.size(),
+                           t.is_compactable( name, f ) ? "  <- compaction candidate" : "" );
+            out << line;
+         }
+      }
+
+      vector<std::pair<account_name, payer_usage>> sorted( payers.begin(), payers.end() );
+      std::sort( sorted.begin(), sorted.end(), []( const auto& a, const auto& b ) { return a.second.billed > b.second.billed; } );
+      out << "top payers:\n";
+      for( size_t i = 0; i < std::min( top_payers, sorted.size() ); ++i ) {
+         std::snprintf( line, sizeof(line), "   %-13s %8llu rows %10llu bytes\n", sorted[i].first.to_string().c_str(),
+                        (unsigned long long)sorted[i].second.rows, (unsigned long long)sorted[i].second.billed );
+         out << line;
+      }
+   }
+
+   /// writes one row per table to `path`, per table field to `path`.fields and per payer to `path`.payers
+   void write_csv( const std::string& path )const {
+      std::ofstream tables_out( path );
+      tables_out << "code,table,scopes,rows,row_bytes,secondary_entries,billed,compactable_bytes\n";
+      std::ofstream fields_out( path + ".fields" );
+      fields_out << "code,table,field,bytes,default_rows,compactable\n";
+      for( const auto& u : usages ) {
+         const auto& t = u.second;
+         tables_out << u.first.first << ',' << u.first.second << ',' << t.tables << ',' << t.row_sizes.size() << ','
+                    << t.value_bytes() << ',' << t.secondary_entries << ',' << t.billed << ',' << t.compactable_bytes() << '\n';
+         for( const auto& f : t.fields ) {
+            fields_out << u.first.first << ',' << u.first.second << ',' << f.first << ',' << f.second.bytes << ','
+                       << f.second.default_rows << ',' << t.is_compactable( f.first, f.second ) << '\n';
+         }
+      }
+      std::ofstream payers_out( path + ".payers" );
+      payers_out << "payer,rows,billed\n";
+      for( const auto& p : payers ) {
+         payers_out << p.first << ',' << p.second.rows << ',' << p.second.billed << '\n';
+      }
+   }
+
+   std::map<std::pair<account_name, table_name>, table_usage> usages;
+   std::map<account_name, payer_usage>                        payers;
+
+private:
+   template<typename Index>
+   static void count_secondary( const chainbase::database& db, const table_id_object& t, table_usage& usage ) {
+      using object_type = typename Index::value_type;
+      const auto& idx = db.get_index<Index, by_primary>();
+      for( auto i = idx.lower_bound( boost::make_tuple( t.id ) ); i != idx.end() && i->t_id == t.id; ++i ) {
+         ++usage.secondary_entries;
+         usage.billed += config::billable_size_v<object_type>;
+      }
+   }
+
+   /// fields of `type` including the ones of its base structs, in serialization order
+   static vector<std::string> struct_fields( const abi_serializer& ser, const std::string& type ) {
+      vector<std::string> fields;
+      const auto& s = ser.get_struct( type );
+      if( !s.base.empty() ) {
+         fields = struct_fields( ser, s.base );
+      }
+      for( const auto& f : s.fields ) {
+         fields.push_back( f.name );
+      }
+      return fields;
+   }
+
+   template<typename Blob>
+   static void add_fields( const abi_serializer& ser, table_usage& usage, const Blob& value, const fc::microseconds& max_time ) {
+      const bytes data( value.data(), value.data() + value.size() );
+      const auto row = ser.binary_to_variant( usage.type, data, max_time ).get_object();
+      add_struct_fields( ser, usage.type, row, usage, max_time );
+   }
+
+   static void add_struct_fields( const abi_serializer& ser, const std::string& type, const fc::variant_object& row,
+                                  table_usage& usage, const fc::microseconds& max_time ) {
+      const auto& s = ser.get_struct( type );
+      if( !s.base.empty() ) {
+         add_struct_fields( ser, s.base, row, usage, max_time );
+      }
+      for( const auto& f : s.fields ) {
+         auto& u = usage.fields[f.name];
+         if( !row.contains( f.name.c_str() ) ) { // absent binary extension
+            ++u.default_rows;
+            continue;
+         }
+         const auto& v = row[f.name];
+         u.bytes += ser.variant_to_binary( f.type, v, max_time ).size();
+         if( is_default( v ) )
+            ++u.default_rows;
+      }
+   }
+
+   static bool is_default( const fc::variant& v ) {
+      switch( v.get_type() ) {
+         case fc::variant::null_type:   return true;
+         case fc::variant::bool_type:   return !v.as_bool();
+         case fc::variant::int64_type:  return v.as_int64() == 0;
+         case fc::variant::uint64_type: return v.as_uint64() == 0;
+         case fc::variant::double_type: return v.as_double() == 0;
+         case fc::variant::array_type:  return v.get_array().empty();
+         case fc::variant::object_type: {
+            for( const auto& e : v.get_object() ) {
+               if( !is_default( e.value() ) )
+                  return false;
+            }
+            return true;
+         }
+         case fc::variant::string_type: {
+            // empty names and strings, zero assets ("0.0000 SYS"), zero big integers and timestamps at the epoch
+            const auto& s = v.get_string();
+            const auto  number = s.substr( 0, s.find( ' ' ) );
+            return s.empty() || number.find_first_not_of( "0." ) == std::string::npos
+                   || s == "1970-01-01T00:00:00.000" || s == "1970-01-01T00:00:00";
+         }
+         default: return false;
+      }
+   }
+};
+
+} // namespace eosio_system
@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""Runs the cases of a Boost.Test binary in parallel worker processes.
+
+Cases are listed with --list_content and split into shards balanced by the
+runtimes recorded on previous runs (cases without history count as the median).
+Every worker runs with its own TMPDIR, so the chain data directories of the
+testers never collide, and writes a JUnit report. The reports are merged into
+one and the runtimes are saved for the next run. Arguments after "--" are
+passed to the binary after its own "--", e.g. --verbose.
+
+    tests/run_sharded.py build/tests/unit_test -j 8 --report unit_test.xml -- --verbose
+"""
+
+import argparse
+import json
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+import xml.etree.ElementTree as ET
+
+
+def list_cases(binary):
+    """Returns "suite/case" paths of all enabled test cases."""
+    out = subprocess.run([binary, "--list_content"], stdout=subprocess.PIPE,
+                         stderr=subprocess.STDOUT, universal_newlines=True, check=True).stdout
+    cases = []
+    stack = []
+    for line in out.splitlines():
+        if not line.strip():
+            continue
+        stripped = line.lstrip()
+        depth = (len(line) - len(stripped)) // 4
+        name = stripped.rstrip("*").strip()
+        enabled = stripped.endswith("*")
+        del stack[depth:]
+        stack.append((name, enabled))
+        if all(e for _, e in stack):
+            cases.append("/".join(n for n, _ in stack))
+    # keep leaves only, suites are prefixes of their cases
+    return [c for c in cases if not any(o.startswith(c + "/") for o in cases)]
+
+
+def load_durations(path):
+    try:
+        with open(path) as f:
+            return json.load(f)
+    except (OSError, ValueError):
+        return {}
+
+
+def make_shards(cases, durations, count):
+    """Longest processing time first: the slowest remaining case goes to the least loaded shard."""
+    known = [durations[c] for c in cases if c in durations]
+    default = statistics.median(known) if known else 1.0
+    weighted = sorted(((durations.get(c, default), c) for c in cases), reverse=True)
+    shards = [[0.0, []] for _ in range(min(count, len(cases)))]
+    for duration, case in weighted:
+        shard = min(shards, key=lambda s: s[0])
+        shard[0] += duration
+        shard[1].append(case)
+    return [s[1] for s in shards if s[1]]
+
+
+def start_worker(binary, index, cases, workdir, extra_args):
+    tmpdir = os.path.join(workdir, "worker%d" % index)
+    os.makedirs(tmpdir)
+    report = os.path.join(workdir, "worker%d.xml" % index)
+    log = open(os.path.join(workdir, "worker%d.log" % index), "w")
+    env = dict(os.environ, TMPDIR=tmpdir)
+    cmd = [binary, "--run_test=" + ":".join(cases),
+           "--logger=HRF,test_suite,stdout:JUNIT,message," + report]
+    if extra_args:
+        cmd += ["--"] + extra_args
+    return subprocess.Popen(cmd, env=env, stdout=log, stderr=subprocess.STDOUT), report, log
+
+
+def merge_reports(reports, path):
+    """Concatenates the testsuite elements of all worker reports, returns per case runtimes."""
+    merged = ET.Element("testsuites")
+    totals = {"tests": 0, "failures": 0, "errors": 0, "skipped": 0}
+    durations = {}
+    for report in reports:
+        try:
+            root = ET.parse(report).getroot()
+        except (OSError, ET.ParseError):
+            continue
+        suites = [root] if root.tag == "testsuite" else root.findall("testsuite")
+        for suite in suites:
+            merged.append(suite)
+            for key in totals:
+                totals[key] += int(suite.get(key, 0))
+            for case in suite.iter("testcase"):
+                name = case.get("classname", "").replace(".", "/")
+                name = (name + "/" if name else "") + case.get("name")
+                durations[name] = float(case.get("time", 0))
+    for key, value in totals.items():
+        merged.set(key, str(value))
+    ET.ElementTree(merged).write(path, encoding="utf-8", xml_declaration=True)
+    return durations
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("binary", help="Boost.Test binary, e.g. build/tests/unit_test")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count() or 1, help="number of worker processes")
+    parser.add_argument("--report", default="test_report.xml", help="merged JUnit report")
+    parser.add_argument("--durations", default=None,
+                        help="runtime history, defaults to .test_durations.json next to the binary")
+    argv = sys.argv[1:]
+    extra_args = argv[argv.index("--") + 1:] if "--" in argv else []
+    opts = parser.parse_args(argv[:argv.index("--")] if "--" in argv else argv)
+
+    binary = os.path.abspath(opts.binary)
+    durations_path = opts.durations or os.path.join(os.path.dirname(binary), ".test_durations.json")
+
+    cases = list_cases(binary)
+    durations = load_durations(durations_path)
+    shards = make_shards(cases, durations, max(1, opts.jobs))
+    print("running %d cases in %d shards" % (len(cases), len(shards)))
+
+    workdir = tempfile.mkdtemp(prefix="sharded_tests.")
+    started = time.time()
+    workers = [start_worker(binary, i, shard, workdir, extra_args) for i, shard in enumerate(shards)]
+    failed = []
+    for i, (proc, _, log) in enumerate(workers):
+        if proc.wait() != 0:
+            failed.append(i)
+        log.close()
+
+    durations.update(merge_reports([r for _, r, _ in workers], opts.report))
+    with open(durations_path, "w") as f:
+        json.dump(durations, f, indent=1, sort_keys=True)
+
+    print("finished in %.1fs, report written to %s" % (time.time() - started, opts.report))
+    for i in failed:
+        print("shard %d failed, log: %s" % (i, os.path.join(workdir, "worker%d.log" % i)))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
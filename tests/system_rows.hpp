@@ -0,0 +1,232 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosio/chain/asset.hpp>
+#include <eosio/chain/block_timestamp.hpp>
+#include <eosio/chain/chain_config.hpp>
+#include <eosio/chain/types.hpp>
+
+#include <fc/crypto/public_key.hpp>
+#include <fc/reflect/reflect.hpp>
+#include <fc/time.hpp>
+
+/**
+ *  Native mirrors of the rows of the system and token contracts, decoded with fc::raw straight from the
+ *  table value instead of through the ABI and fc::variant. Field order and types must follow the
+ *  EOSLIB_SERIALIZE declarations of the contracts; the typed_row_readers test checks them against the ABI.
+ */
+namespace eosio_system { namespace rows {
+
+using eosio::chain::account_name;
+using eosio::chain::asset;
+using eosio::chain::block_timestamp_type;
+
+struct voter_info {
+   account_name               owner;
+   account_name               proxy;
+   std::vector<account_name>  producers;
+   int64_t                    staked = 0;
+   double                     last_vote_weight = 0;
+   double                     proxied_vote_weight = 0;
+   bool                       is_proxy = false;
+   uint32_t                   flags1 = 0;
+   uint32_t                   vote_epoch = 0;
+   asset                      reserved3;
+   bool                       has_voted = false;
+};
+
+struct producer_info {
+   account_name            owner;
+   double                  total_votes = 0;
+   fc::crypto::public_key  producer_key;
+   bool                    is_active = true;
+   std::string             url;
+   uint32_t                unpaid_blocks = 0;
+   fc::time_point          last_claim_time;
+   uint16_t                location = 0;
+};
+
+struct producer_info2 {
+   account_name    owner;
+   double          votepay_share = 0;
+   fc::time_point  last_votepay_share_update;
+};
+
+struct producer_votepay_offset {
+   account_name  owner;
+   double        offset = 0;
+};
+
+struct proxy_follower {
+   account_name  owner;
+   int64_t       staked = 0;
+};
+
+struct proxy_stats {
+   account_name  owner;
+   uint32_t      followers = 0;
+   int64_t       staked = 0;
+   bool          rebuilding = false;
+   account_name  rebuild_cursor;
+   double        rebuild_weight = 0;
+   uint16_t      rebuild_epoch = 0;
+};
+
+struct autopay_info {
+   account_name  owner;
+   int64_t       per_block_pay = 0;
+   int64_t       per_vote_pay = 0;
+};
+
+struct maintenance_task {
+   account_name  task;
+   uint32_t      interval = 0;
+   uint16_t      batch_size = 0;
+   uint32_t      next_slot = 0;
+};
+
+struct eosio_global_state : eosio::chain::chain_config {
+   uint64_t              max_ram_size = 0;
+   uint64_t              total_ram_bytes_reserved = 0;
+   int64_t               total_ram_stake = 0;
+   block_timestamp_type  last_producer_schedule_update;
+   fc::time_point        last_pervote_bucket_fill;
+   int64_t               pervote_bucket = 0;
+   int64_t               perblock_bucket = 0;
+   uint32_t              total_unpaid_blocks = 0;
+   int64_t               total_activated_stake = 0;
+   int64_t               active_stake = 0;
+   fc::time_point        thresh_activated_stake_time;
+   uint16_t              target_producer_schedule_size = 0;
+   uint16_t              last_producer_schedule_size = 0;
+   double                total_producer_vote_weight = 0;
+   block_timestamp_type  last_name_close;
+   block_timestamp_type  last_target_schedule_size_update;
+   uint32_t              schedule_update_interval = 0;
+   uint16_t              schedule_size_step = 0;
+};
+
+struct eosio_global_state2 {
+   uint16_t              new_ram_per_block = 0;
+   block_timestamp_type  last_ram_increase;
+   block_timestamp_type  last_block_num;
+   double                total_producer_votepay_share = 0;
+   uint8_t               revision = 0;
+};
+
+struct eosio_global_state3 {
+   fc::time_point  last_vpay_state_update;
+   double          total_vpay_share_change_rate = 0;
+};
+
+struct eosio_global_state4 {
+   uint8_t        schedule_order = 0;
+   uint16_t       autopay_batch_size = 0;
+   account_name   autopay_cursor;
+   uint16_t       vote_epoch = 0;
+   account_name   vote_sweep_cursor;
+   bool           vote_sweep_pending = false;
+   uint32_t       vote_expiry_time = 0;
+   account_name   proxy_index_cursor;
+   bool           proxy_index_complete = false;
+   double         vote_propagation_epsilon = 0;
+   uint16_t       vote_flush_batch_size = 0;
+   uint8_t        schedule_size_strategy = 0;
+   uint16_t       schedule_size_band = 0;
+   uint8_t        schedule_size_gain = 0;
+   uint32_t       maintenance_budget = 0;
+   account_name   maintenance_cursor;
+   uint32_t       next_maintenance_slot = 0;
+   bool           emission_streaming = false;
+   account_name   vote_activity_cursor;
+   bool           vote_activity_complete = false;
+   uint8_t        producer_sweep_phase = 0;
+   account_name   producer_sweep_cursor;
+   double         producer_sweep_key = 0;
+   double         producer_sweep_scale = 0;
+};
+
+struct elected_candidate {
+   account_name            owner;
+   double                  total_votes = 0;
+   fc::crypto::public_key  producer_key;
+   uint16_t                location = 0;
+};
+
+struct election_cache {
+   std::vector<elected_candidate>  candidates;
+   double                          max_excluded_votes = 0;
+   uint16_t                        capacity = 0;
+};
+
+struct election_preview {
+   std::vector<account_name>  producers;
+   uint16_t                   target_schedule_size = 0;
+   double                     cutoff_votes = 0;
+   uint16_t                   vote_epoch = 0;
+   block_timestamp_type       last_change;
+};
+
+struct user_resources {
+   account_name  owner;
+   asset         net_weight;
+   asset         cpu_weight;
+   asset         vote_weight;
+   int64_t       ram_bytes = 0;
+};
+
+struct refund_request {
+   account_name        owner;
+   fc::time_point_sec  request_time;
+   asset               net_amount;
+   asset               cpu_amount;
+   asset               vote_amount;
+};
+
+struct account {
+   asset balance;
+};
+
+struct currency_stats {
+   asset         supply;
+   asset         max_supply;
+   account_name  issuer;
+};
+
+} } // namespace eosio_system::rows
+
+FC_REFLECT( eosio_system::rows::voter_info, (owner)(proxy)(producers)(staked)(last_vote_weight)(proxied_vote_weight)(is_proxy)
+            (flags1)(vote_epoch)(reserved3)(has_voted) )
+FC_REFLECT( eosio_system::rows::producer_info, (owner)(total_votes)(producer_key)(is_active)(url)(unpaid_blocks)(last_claim_time)(location) )
+FC_REFLECT( eosio_system::rows::producer_info2, (owner)(votepay_share)(last_votepay_share_update) )
+FC_REFLECT( eosio_system::rows::producer_votepay_offset, (owner)(offset) )
+FC_REFLECT( eosio_system::rows::proxy_follower, (owner)(staked) )
+FC_REFLECT( eosio_system::rows::proxy_stats, (owner)(followers)(staked)(rebuilding)(rebuild_cursor)(rebuild_weight)(rebuild_epoch) )
+FC_REFLECT( eosio_system::rows::autopay_info, (owner)(per_block_pay)(per_vote_pay) )
+FC_REFLECT( eosio_system::rows::maintenance_task, (task)(interval)(batch_size)(next_slot) )
+FC_REFLECT_DERIVED( eosio_system::rows::eosio_global_state, (eosio::chain::chain_config),
+                    (max_ram_size)(total_ram_bytes_reserved)(total_ram_stake)
+                    (last_producer_schedule_update)(last_pervote_bucket_fill)
+                    (pervote_bucket)(perblock_bucket)(total_unpaid_blocks)(total_activated_stake)(active_stake)(thresh_activated_stake_time)
+                    (target_producer_schedule_size)(last_producer_schedule_size)(total_producer_vote_weight)(last_name_close)
+                    (last_target_schedule_size_update)(schedule_update_interval)(schedule_size_step) )
+FC_REFLECT( eosio_system::rows::eosio_global_state2, (new_ram_per_block)(last_ram_increase)(last_block_num)(total_producer_votepay_share)(revision) )
+FC_REFLECT( eosio_system::rows::eosio_global_state3, (last_vpay_state_update)(total_vpay_share_change_rate) )
+FC_REFLECT( eosio_system::rows::eosio_global_state4, (schedule_order)
+            (autopay_batch_size)(autopay_cursor)(vote_epoch)(vote_sweep_cursor)(vote_sweep_pending)
+            (vote_expiry_time)(proxy_index_cursor)(proxy_index_complete)
+            (vote_propagation_epsilon)(vote_flush_batch_size)
+            (schedule_size_strategy)(schedule_size_band)(schedule_size_gain)
+            (maintenance_budget)(maintenance_cursor)(next_maintenance_slot)(emission_streaming)
+            (vote_activity_cursor)(vote_activity_complete)
+            (producer_sweep_phase)(producer_sweep_cursor)(producer_sweep_key)(producer_sweep_scale) )
+FC_REFLECT( eosio_system::rows::elected_candidate, (owner)(total_votes)(producer_key)(location) )
+FC_REFLECT( eosio_system::rows::election_cache, (candidates)(max_excluded_votes)(capacity) )
+FC_REFLECT( eosio_system::rows::election_preview, (producers)(target_schedule_size)(cutoff_votes)(vote_epoch)(last_change) )
+FC_REFLECT( eosio_system::rows::user_resources, (owner)(net_weight)(cpu_weight)(vote_weight)(ram_bytes) )
+FC_REFLECT( eosio_system::rows::refund_request, (owner)(request_time)(net_amount)(cpu_amount)(vote_amount) )
+FC_REFLECT( eosio_system::rows::account, (balance) )
+FC_REFLECT( eosio_system::rows::currency_stats, (supply)(max_supply)(issuer) )